@@ -12,22 +12,88 @@ INCLUDECONSTS_OUTDIR := include/constants
 AUTO_GEN_TARGETS += $(INCLUDECONSTS_OUTDIR)/map_groups.h
 AUTO_GEN_TARGETS += $(INCLUDECONSTS_OUTDIR)/layouts.h
 
-MAP_DIRS := $(dir $(wildcard $(MAPS_DIR)/*/map.json))
+MAP_JSONS := $(wildcard $(MAPS_DIR)/*/map.json)
+MAP_DIRS := $(dir $(MAP_JSONS))
 MAP_CONNECTIONS := $(patsubst $(MAPS_DIR)/%/,$(MAPS_DIR)/%/connections.inc,$(MAP_DIRS))
 MAP_EVENTS := $(patsubst $(MAPS_DIR)/%/,$(MAPS_DIR)/%/events.inc,$(MAP_DIRS))
 MAP_HEADERS := $(patsubst $(MAPS_DIR)/%/,$(MAPS_DIR)/%/header.inc,$(MAP_DIRS))
+MAPS_STAMP := $(MAPS_OUTDIR)/world.stamp
+MAP_GROUPS_STAMP := $(MAPS_OUTDIR)/groups.stamp
+LAYOUTS_STAMP := $(LAYOUTS_OUTDIR)/layouts.stamp
 
+# clean-generated removes map_groups.h and layouts.h, so it has to remove what
+# records that they're up to date too.
+AUTO_GEN_TARGETS += $(MAPS_STAMP) $(MAP_GROUPS_STAMP) $(LAYOUTS_STAMP)
+
+# With MAP_OBJECTS=1, mapjson writes maps.o and map_events.o itself, without
+# generating and assembling the .inc files in between.
+MAP_OBJECTS ?= 0
+
+ifeq ($(MAP_OBJECTS),1)
+LAYOUT_BINS := $(wildcard $(LAYOUTS_DIR)/*/*.bin)
+MAP_DEFINITIONS := $(DATA_ASM_BUILDDIR)/maps.defs $(DATA_ASM_BUILDDIR)/map_events.defs
+
+# The constants map data refers to come from the includes of each .s file, as
+# the assembler would get them. The map data it includes is left out, since
+# mapjson provides that, so these only change along with the headers.
+$(DATA_ASM_BUILDDIR)/%.defs: $(DATA_ASM_SUBDIR)/%.s $(wildcard asm/macros.inc asm/macros/*.inc asm/macros/*/*.inc constants/*.inc)
+	grep -v '\.include "$(DATA_ASM_SUBDIR)/' $< | $(PREPROC) -i $< charmap.txt | $(CPP) -I include -dD -MD -MF $@.d -MT $@ - > $@
+
+ifneq ($(NODEP),1)
+-include $(MAP_DEFINITIONS:=.d)
+endif
+
+ifeq (,$(filter grouped-target,$(.FEATURES)))
+$(error MAP_OBJECTS=1 needs GNU Make 4.3 or later)
+endif
+
+# One run writes both objects.
+$(DATA_ASM_BUILDDIR)/maps.o $(DATA_ASM_BUILDDIR)/map_events.o &: $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(MAP_JSONS) $(LAYOUT_BINS) $(MAP_DEFINITIONS)
+	$(MAPJSON) object emerald $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(DATA_ASM_BUILDDIR)/maps.o $(DATA_ASM_BUILDDIR)/maps.defs $(DATA_ASM_BUILDDIR)/map_events.o $(DATA_ASM_BUILDDIR)/map_events.defs
+else
 $(DATA_ASM_BUILDDIR)/maps.o: $(DATA_ASM_SUBDIR)/maps.s $(LAYOUTS_DIR)/layouts.inc $(LAYOUTS_DIR)/layouts_table.inc $(MAPS_DIR)/headers.inc $(MAPS_DIR)/groups.inc $(MAPS_DIR)/connections.inc $(MAP_CONNECTIONS) $(MAP_HEADERS)
 	$(PREPROC) $< charmap.txt | $(CPP) -I include - | $(PREPROC) -ie $< charmap.txt | $(AS) $(ASFLAGS) -o $@
 $(DATA_ASM_BUILDDIR)/map_events.o: $(DATA_ASM_SUBDIR)/map_events.s $(MAPS_DIR)/events.inc $(MAP_EVENTS)
 	$(PREPROC) $< charmap.txt | $(CPP) -I include - | $(PREPROC) -ie $< charmap.txt | $(AS) $(ASFLAGS) -o $@
+endif
+
+
+# mapjson only rewrites outputs whose text changed, so each run is recorded in
+# a stamp file, and the outputs depend on that instead of on the JSON. Deleting
+# an output doesn't make its stamp out of date, so a stamp is also rerun while
+# any of its outputs is missing.
+.PHONY: mapjson-outputs-missing
+mapjson_if_missing = $(if $(filter-out $(wildcard $(1)),$(1)),mapjson-outputs-missing)
 
+# One world run generates the files of every map.
+$(MAPS_STAMP): $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(MAP_JSONS) $(call mapjson_if_missing,$(MAP_CONNECTIONS) $(MAP_EVENTS) $(MAP_HEADERS))
+	$(MAPJSON) world emerald $< $(LAYOUTS_DIR)/layouts.json $(MAPS_OUTDIR)
+	@touch $@
 
-$(MAPS_OUTDIR)/%/header.inc $(MAPS_OUTDIR)/%/events.inc $(MAPS_OUTDIR)/%/connections.inc: $(MAPS_DIR)/%/map.json
-	$(MAPJSON) map emerald $< $(LAYOUTS_DIR)/layouts.json $(@D)
+$(MAP_CONNECTIONS) $(MAP_EVENTS) $(MAP_HEADERS): $(MAPS_STAMP) ;
 
-$(MAPS_OUTDIR)/connections.inc $(MAPS_OUTDIR)/groups.inc $(MAPS_OUTDIR)/events.inc $(MAPS_OUTDIR)/headers.inc $(INCLUDECONSTS_OUTDIR)/map_groups.h: $(MAPS_DIR)/map_groups.json
+MAP_GROUPS_OUTPUTS := $(MAPS_OUTDIR)/connections.inc $(MAPS_OUTDIR)/groups.inc $(MAPS_OUTDIR)/events.inc $(MAPS_OUTDIR)/headers.inc $(INCLUDECONSTS_OUTDIR)/map_groups.h
+
+$(MAP_GROUPS_STAMP): $(MAPS_DIR)/map_groups.json $(call mapjson_if_missing,$(MAP_GROUPS_OUTPUTS))
 	$(MAPJSON) groups emerald $< $(MAPS_OUTDIR) $(INCLUDECONSTS_OUTDIR)
+	@touch $@
+
+$(MAP_GROUPS_OUTPUTS): $(MAP_GROUPS_STAMP) ;
 
-$(LAYOUTS_OUTDIR)/layouts.inc $(LAYOUTS_OUTDIR)/layouts_table.inc $(INCLUDECONSTS_OUTDIR)/layouts.h: $(LAYOUTS_DIR)/layouts.json
+LAYOUTS_OUTPUTS := $(LAYOUTS_OUTDIR)/layouts.inc $(LAYOUTS_OUTDIR)/layouts_table.inc $(INCLUDECONSTS_OUTDIR)/layouts.h
+
+$(LAYOUTS_STAMP): $(LAYOUTS_DIR)/layouts.json $(call mapjson_if_missing,$(LAYOUTS_OUTPUTS))
 	$(MAPJSON) layouts emerald $< $(LAYOUTS_OUTDIR) $(INCLUDECONSTS_OUTDIR)
+	@touch $@
+
+$(LAYOUTS_OUTPUTS): $(LAYOUTS_STAMP) ;
+
+# The connections and warps of every map in one file, for tools that look at
+# the world as a whole. Nothing in the build needs it; "make map_graph" writes it.
+MAP_GRAPH := $(MAPS_OUTDIR)/map_graph.json
+
+.PHONY: map_graph
+map_graph: $(MAP_GRAPH)
+
+$(MAP_GRAPH): $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(MAP_JSONS)
+	$(MAPJSON) graph emerald $< $(LAYOUTS_DIR)/layouts.json $@
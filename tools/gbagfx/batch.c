@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "global.h"
+#include "util.h"
+#include "batch.h"
+
+enum JobState
+{
+    JOB_PENDING,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+struct Job
+{
+    int argc;
+    char **argv;
+    int dependency;
+    enum JobState state;
+};
+
+struct Batch
+{
+    struct Job *jobs;
+    int numJobs;
+    int nextJob;
+    BatchCommandFunction runCommand;
+    bool failed;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobDone;
+};
+
+static struct Batch sBatch;
+
+// A failed job may have left partial output behind, which make would then take
+// as up to date. Only called once every thread has stopped.
+static void RemoveUnfinishedOutputs(void)
+{
+    for (int i = 0; i < sBatch.numJobs; i++)
+    {
+        if (sBatch.jobs[i].state == JOB_RUNNING)
+            remove(sBatch.jobs[i].argv[2]);
+    }
+}
+
+int GetProcessorCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? count : 1;
+#endif
+}
+
+static uint32_t HashPath(const char *path)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*path)
+        hash = (hash ^ (unsigned char)*path++) * 16777619u;
+
+    return hash;
+}
+
+// Links each job to the last earlier job that writes its input, using an
+// open-addressed table of output paths.
+static void FindDependencies(struct Job *jobs, int numJobs)
+{
+    int tableSize = 16;
+
+    while (tableSize < numJobs * 2)
+        tableSize *= 2;
+
+    int *table = malloc(tableSize * sizeof(int));
+
+    if (table == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+
+    for (int i = 0; i < tableSize; i++)
+        table[i] = -1;
+
+    for (int i = 0; i < numJobs; i++)
+    {
+        struct Job *job = &jobs[i];
+        uint32_t slot = HashPath(job->argv[1]) & (tableSize - 1);
+
+        job->dependency = -1;
+
+        while (table[slot] >= 0)
+        {
+            if (strcmp(jobs[table[slot]].argv[2], job->argv[1]) == 0)
+            {
+                job->dependency = table[slot];
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        slot = HashPath(job->argv[2]) & (tableSize - 1);
+
+        while (table[slot] >= 0 && strcmp(jobs[table[slot]].argv[2], job->argv[2]) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        table[slot] = i;
+    }
+
+    free(table);
+}
+
+static void ReadManifest(char *manifestPath, struct Batch *batch)
+{
+    int size;
+    char *text = (char *)ReadWholeFileZeroPadded(manifestPath, &size, 1);
+    int capacity = 64;
+
+    batch->jobs = malloc(capacity * sizeof(struct Job));
+    batch->numJobs = 0;
+
+    if (batch->jobs == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+
+    int lineNum = 0;
+
+    for (char *line = text; *line != 0;)
+    {
+        char *lineEnd = strchr(line, '\n');
+        char *next = lineEnd != NULL ? lineEnd + 1 : line + strlen(line);
+
+        lineNum++;
+
+        if (lineEnd != NULL)
+            *lineEnd = 0;
+
+        // Split the line into arguments in place; argv[0] stands in for the program name.
+        char **argv = malloc((strlen(line) / 2 + 3) * sizeof(char *));
+        int argc = 1;
+
+        if (argv == NULL)
+            FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+
+        argv[0] = "gbagfx";
+
+        for (char *arg = strtok(line, " \t\r"); arg != NULL; arg = strtok(NULL, " \t\r"))
+            argv[argc++] = arg;
+
+        argv[argc] = NULL;
+        line = next;
+
+        if (argc == 1 || argv[1][0] == '#')
+        {
+            free(argv);
+            continue;
+        }
+
+        if (argc < 3)
+            FATAL_ERROR("%s:%d: no output path.\n", manifestPath, lineNum);
+
+        if (batch->numJobs == capacity)
+        {
+            capacity *= 2;
+            batch->jobs = realloc(batch->jobs, capacity * sizeof(struct Job));
+
+            if (batch->jobs == NULL)
+                FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+        }
+
+        batch->jobs[batch->numJobs].argc = argc;
+        batch->jobs[batch->numJobs].argv = argv;
+        batch->jobs[batch->numJobs].state = JOB_PENDING;
+        batch->numJobs++;
+    }
+
+    // The arguments point into the manifest text, so it stays allocated.
+    FindDependencies(batch->jobs, batch->numJobs);
+}
+
+// Jobs are claimed in manifest order, so any job another one waits for has
+// already been claimed, and waiting can't deadlock. Once a job fails, no more
+// are started, but the running ones are left to finish.
+static void *RunJobs(void *arg UNUSED)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&sBatch.mutex);
+
+        if (sBatch.failed || sBatch.nextJob == sBatch.numJobs)
+        {
+            pthread_mutex_unlock(&sBatch.mutex);
+            return NULL;
+        }
+
+        struct Job *job = &sBatch.jobs[sBatch.nextJob++];
+
+        while (!sBatch.failed && job->dependency >= 0 && sBatch.jobs[job->dependency].state != JOB_DONE)
+            pthread_cond_wait(&sBatch.jobDone, &sBatch.mutex);
+
+        if (sBatch.failed)
+        {
+            pthread_mutex_unlock(&sBatch.mutex);
+            return NULL;
+        }
+
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&sBatch.mutex);
+
+        // The error has already been reported; the job stays running, so that
+        // its output is removed.
+        jmp_buf errorJump;
+        bool failed = setjmp(errorJump) != 0;
+
+        if (!failed)
+        {
+            gErrorJump = &errorJump;
+            sBatch.runCommand(job->argc, job->argv);
+        }
+
+        gErrorJump = NULL;
+
+        pthread_mutex_lock(&sBatch.mutex);
+        if (failed)
+            sBatch.failed = true;
+        else
+            job->state = JOB_DONE;
+        pthread_cond_broadcast(&sBatch.jobDone);
+        pthread_mutex_unlock(&sBatch.mutex);
+    }
+}
+
+void RunBatch(char *manifestPath, int jobCount, BatchCommandFunction runCommand)
+{
+    pthread_mutex_init(&sBatch.mutex, NULL);
+    pthread_cond_init(&sBatch.jobDone, NULL);
+    ReadManifest(manifestPath, &sBatch);
+    sBatch.nextJob = 0;
+    sBatch.runCommand = runCommand;
+
+    if (jobCount > sBatch.numJobs)
+        jobCount = sBatch.numJobs;
+
+    pthread_t *threads = malloc(jobCount * sizeof(pthread_t));
+
+    if (jobCount > 1 && threads == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch threads.\n");
+
+    for (int i = 1; i < jobCount; i++)
+    {
+        if (pthread_create(&threads[i], NULL, RunJobs, NULL) != 0)
+            FATAL_ERROR("Failed to start batch thread.\n");
+    }
+
+    RunJobs(NULL);
+
+    for (int i = 1; i < jobCount; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+
+    if (sBatch.failed)
+    {
+        RemoveUnfinishedOutputs();
+        exit(1);
+    }
+}
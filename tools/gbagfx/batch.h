@@ -0,0 +1,17 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Runs one gbagfx command line; argv[1] and argv[2] are the input and output paths.
+typedef void (*BatchCommandFunction)(int argc, char **argv);
+
+// The default number of batch threads.
+int GetProcessorCount(void);
+
+// Runs every job listed in a manifest from a pool of jobCount threads. Each
+// line of the manifest holds the arguments of one gbagfx invocation:
+// INPUT_PATH OUTPUT_PATH [options...]. Blank lines and lines starting with
+// '#' are ignored. A job whose input is the output of an earlier job waits
+// for it, so a PNG can be converted and compressed in the same batch.
+void RunBatch(char *manifestPath, int jobCount, BatchCommandFunction runCommand);
+
+#endif // BATCH_H
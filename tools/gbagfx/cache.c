@@ -0,0 +1,362 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#include "global.h"
+#include "util.h"
+#include "cache.h"
+
+// Bump this when the way entries are keyed or stored changes.
+#define CACHE_FORMAT "1"
+
+// The Makefile passes a checksum of the gbagfx sources, so that outputs made
+// by another version of the code are never reused. Without it, nothing is
+// cached.
+#ifdef GBAGFX_SOURCE_HASH
+static const char sBuildId[] = CACHE_FORMAT " " GBAGFX_SOURCE_HASH;
+#else
+static const char sBuildId[] = "";
+#endif
+
+struct Hash
+{
+    uint64_t a;
+    uint64_t b;
+};
+
+static void HashWord(struct Hash *hash, uint64_t word)
+{
+    hash->a = (hash->a ^ word) * 0x100000001B3ULL;
+    hash->a ^= hash->a >> 32;
+    hash->b = (hash->b + word) * 0x9E3779B97F4A7C15ULL;
+    hash->b ^= hash->b >> 29;
+}
+
+// Two independent 64-bit multiply-xorshift hashes, fed eight bytes at a time.
+static void HashBytes(struct Hash *hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    uint64_t word;
+
+    for (; size >= 8; bytes += 8, size -= 8)
+    {
+        memcpy(&word, bytes, 8);
+        HashWord(hash, word);
+    }
+
+    word = 0;
+    memcpy(&word, bytes, size);
+    HashWord(hash, word ^ ((uint64_t)size << 56));
+}
+
+static void HashString(struct Hash *hash, const char *s)
+{
+    HashBytes(hash, s, strlen(s) + 1);
+}
+
+static bool HashFile(struct Hash *hash, char *path)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        return false;
+
+    unsigned char buffer[65536];
+    size_t size;
+    uint64_t totalSize = 0;
+
+    while ((size = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        HashBytes(hash, buffer, size);
+        totalSize += size;
+    }
+
+    bool success = !ferror(fp);
+    fclose(fp);
+
+    HashBytes(hash, &totalSize, sizeof(totalSize));
+    return success;
+}
+
+static bool CopyFileContents(char *sourcePath, char *destPath)
+{
+    FILE *source = fopen(sourcePath, "rb");
+
+    if (source == NULL)
+        return false;
+
+    FILE *dest = fopen(destPath, "wb");
+
+    if (dest == NULL)
+    {
+        fclose(source);
+        return false;
+    }
+
+    bool success = true;
+
+#ifdef FICLONE
+    // Filesystems with copy-on-write support (Btrfs, XFS) can share the data
+    // instead of copying it.
+    if (ioctl(fileno(dest), FICLONE, fileno(source)) != 0)
+#endif
+    {
+        unsigned char buffer[65536];
+        size_t size;
+
+        while (success && (size = fread(buffer, 1, sizeof(buffer), source)) > 0)
+            success = fwrite(buffer, 1, size, dest) == size;
+
+        if (ferror(source))
+            success = false;
+    }
+
+    fclose(source);
+
+    if (fclose(dest) != 0)
+        success = false;
+
+    return success;
+}
+
+static void MakeDirectory(char *path)
+{
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0777);
+#endif
+}
+
+// Commands that write files besides their output can't be restored from the
+// cache: PNG conversions generating a tilemap, and fused conversions that
+// keep the intermediate file.
+static bool HasExtraOutputs(char *inputPath, int argc, char **argv)
+{
+    bool isPngInput = strcmp(GetFileExtensionAfterDot(inputPath), "png") == 0;
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-keep_intermediate") == 0 || (isPngInput && strcmp(argv[i], "-tilemap") == 0))
+            return true;
+    }
+
+    return false;
+}
+
+// Hits and misses are added to the stats file of the cache when gbagfx exits.
+static pthread_mutex_t sStatsMutex = PTHREAD_MUTEX_INITIALIZER;
+static char *sStatsCacheDir;
+static int sHits;
+static int sMisses;
+static int sTempFileCount;
+
+static char *GetStatsPath(char *cacheDir)
+{
+    char *path = malloc(strlen(cacheDir) + 7);
+
+    if (path == NULL)
+        FATAL_ERROR("Failed to allocate memory for cache path.\n");
+
+    sprintf(path, "%s/stats", cacheDir);
+    return path;
+}
+
+static void WriteCacheStats(void)
+{
+    pthread_mutex_lock(&sStatsMutex);
+
+    char *statsPath = GetStatsPath(sStatsCacheDir);
+    FILE *fp = fopen(statsPath, "a");
+
+    if (fp != NULL)
+    {
+        fprintf(fp, "%d %d\n", sHits, sMisses);
+        fclose(fp);
+    }
+
+    free(statsPath);
+
+    pthread_mutex_unlock(&sStatsMutex);
+}
+
+static void CountLookup(char *cacheDir, bool hit)
+{
+    pthread_mutex_lock(&sStatsMutex);
+
+    if (sStatsCacheDir == NULL)
+    {
+        sStatsCacheDir = cacheDir;
+        atexit(WriteCacheStats);
+    }
+
+    if (hit)
+        sHits++;
+    else
+        sMisses++;
+
+    pthread_mutex_unlock(&sStatsMutex);
+}
+
+// Every extension of a path, like "4bpp.lz" for "graphics/a.4bpp.lz", since
+// the ones before the last choose the format of a compressed output.
+static const char *GetFullExtension(const char *path)
+{
+    const char *name = path;
+
+    for (const char *p = path; *p != 0; p++)
+        if (*p == '/' || *p == '\\')
+            name = p + 1;
+
+    const char *dot = strchr(name, '.');
+
+    return dot != NULL ? dot + 1 : "";
+}
+
+bool RestoreCachedOutput(char *inputPath, char *outputPath, int argc, char **argv, struct CacheEntry *entry)
+{
+    char *cacheDir = getenv("GBAGFX_CACHE");
+
+    entry->path = NULL;
+
+    if (cacheDir == NULL || *cacheDir == 0 || *sBuildId == 0 || HasExtraOutputs(inputPath, argc, argv))
+        return false;
+
+    struct Hash hash = { 0xCBF29CE484222325ULL, 0 };
+
+    HashString(&hash, sBuildId);
+    HashString(&hash, GetFullExtension(inputPath));
+    HashString(&hash, GetFullExtension(outputPath));
+
+    for (int i = 3; i < argc; i++)
+        HashString(&hash, argv[i]);
+
+    // Leave unreadable inputs for the command to report.
+    if (!HashFile(&hash, inputPath))
+        return false;
+
+    // Options naming a file, like -palette, depend on its contents.
+    for (int i = 3; i < argc; i++)
+    {
+        struct stat st;
+
+        if (stat(argv[i], &st) == 0 && S_ISREG(st.st_mode))
+            HashFile(&hash, argv[i]);
+    }
+
+    entry->path = malloc(strlen(cacheDir) + 34);
+
+    if (entry->path == NULL)
+        FATAL_ERROR("Failed to allocate memory for cache path.\n");
+
+    sprintf(entry->path, "%s/%016llx%016llx", cacheDir, (unsigned long long)hash.a, (unsigned long long)hash.b);
+
+    FILE *fp = fopen(entry->path, "rb");
+    bool hit = fp != NULL;
+
+    if (hit)
+    {
+        fclose(fp);
+
+        if (!CopyFileContents(entry->path, outputPath))
+        {
+            remove(outputPath);
+            hit = false;
+        }
+    }
+
+    CountLookup(cacheDir, hit);
+
+    if (hit)
+    {
+        free(entry->path);
+        entry->path = NULL;
+    }
+
+    return hit;
+}
+
+void StoreCachedOutput(struct CacheEntry *entry, char *outputPath)
+{
+    if (entry->path == NULL)
+        return;
+
+    // The output goes in under a temporary name first, so that other gbagfx
+    // processes never see a partial file.
+    char *tempPath = malloc(strlen(entry->path) + 32);
+
+    if (tempPath == NULL)
+        FATAL_ERROR("Failed to allocate memory for cache path.\n");
+
+    pthread_mutex_lock(&sStatsMutex);
+    sprintf(tempPath, "%s.%d.%d", entry->path, (int)getpid(), sTempFileCount++);
+    pthread_mutex_unlock(&sStatsMutex);
+
+    bool stored = CopyFileContents(outputPath, tempPath);
+
+    if (!stored)
+    {
+        // The cache directory may not exist yet.
+        char *cacheDir = getenv("GBAGFX_CACHE");
+
+        MakeDirectory(cacheDir);
+        stored = CopyFileContents(outputPath, tempPath);
+    }
+
+    if (!stored || rename(tempPath, entry->path) != 0)
+        remove(tempPath);
+
+    free(tempPath);
+    free(entry->path);
+    entry->path = NULL;
+}
+
+void PrintCacheStats(char *cacheDir, bool reset)
+{
+    char *statsPath = GetStatsPath(cacheDir);
+    FILE *fp = fopen(statsPath, "r");
+    long hits = 0;
+    long misses = 0;
+
+    if (fp != NULL)
+    {
+        int processHits;
+        int processMisses;
+
+        while (fscanf(fp, "%d %d", &processHits, &processMisses) == 2)
+        {
+            hits += processHits;
+            misses += processMisses;
+        }
+
+        fclose(fp);
+    }
+
+    printf("%ld hits, %ld misses", hits, misses);
+
+    if (hits + misses > 0)
+        printf(" (%.1f%% hit rate)", 100.0 * hits / (hits + misses));
+
+    printf("\n");
+
+    if (reset)
+        remove(statsPath);
+
+    free(statsPath);
+}
@@ -0,0 +1,26 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+
+// Outputs can be kept in the directory named by the GBAGFX_CACHE environment
+// variable, under a hash of everything they depend on: the gbagfx build, the
+// file extensions and options, the contents of the input file and of any other
+// files named by the options.
+
+struct CacheEntry
+{
+    char *path;
+};
+
+// Looks up the output of a command and copies it to outputPath if it's in the
+// cache. Otherwise prepares entry for StoreCachedOutput, which adds the output
+// once the command has made it.
+bool RestoreCachedOutput(char *inputPath, char *outputPath, int argc, char **argv, struct CacheEntry *entry);
+void StoreCachedOutput(struct CacheEntry *entry, char *outputPath);
+
+// Prints the hits and misses recorded in a cache directory since it was
+// created or last reset.
+void PrintCacheStats(char *cacheDir, bool reset);
+
+#endif // CACHE_H
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Checks that GBAGFX_CACHE keeps outputs apart that differ only in the
+# extensions before the last, by converting one PNG to two .lz outputs with
+# and without the cache.
+
+set -e
+
+GBAGFX=${GBAGFX:-./gbagfx}
+PNG=${1:-../../graphics/pokemon/bulbasaur/front.png}
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+for output in tiles.4bpp.lz palette.gbapal.lz; do
+    "$GBAGFX" "$PNG" "$dir/expected.$output"
+done
+
+mkdir "$dir/cache"
+for output in tiles.4bpp.lz palette.gbapal.lz; do
+    GBAGFX_CACHE="$dir/cache" "$GBAGFX" "$PNG" "$dir/cached.$output"
+    if ! cmp -s "$dir/expected.$output" "$dir/cached.$output"; then
+        echo "cache_test: cached $output differs from an uncached conversion" >&2
+        exit 1
+    fi
+done
+
+echo "cache_test: cached outputs match."
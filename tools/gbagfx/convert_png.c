@@ -45,35 +45,34 @@ static FILE *PngReadOpen(char *path, png_structp *pngStruct, png_infop *pngInfo)
     return fp;
 }
 
-static unsigned char *ConvertBitDepth(unsigned char *src, int srcBitDepth, int destBitDepth, int numPixels)
+// Packs one decoded row into the bit depth of the image, continuing from the
+// given pixel. Each pixel keeps only the bits that fit.
+static void PackRow(unsigned char *src, int srcBitDepth, unsigned char *dest, int destBitDepth, int firstPixel, int width)
 {
-    // Round the number of bits up to the next 8 and divide by 8 to get the number of bytes.
-    int srcSize = ((numPixels * srcBitDepth + 7) & ~7) / 8;
-    int destSize = ((numPixels * destBitDepth + 7) & ~7) / 8;
-    unsigned char *output = calloc(destSize, 1);
-    unsigned char *dest = output;
-    int i;
-    int j;
-    int destBit = 8 - destBitDepth;
-
-    for (i = 0; i < srcSize; i++)
+    if (srcBitDepth == 8 && destBitDepth == 4 && firstPixel % 2 == 0)
     {
-        unsigned char srcByte = src[i];
+        dest += firstPixel / 2;
 
-        for (j = 8 - srcBitDepth; j >= 0; j -= srcBitDepth)
-        {
-            unsigned char pixel = ((srcByte >> j) % (1 << srcBitDepth)) % (1 << destBitDepth);
-            *dest |= pixel << destBit;
-            destBit -= destBitDepth;
-            if (destBit < 0)
-            {
-                dest++;
-                destBit = 8 - destBitDepth;
-            }
-        }
+        for (int x = 0; x + 1 < width; x += 2)
+            *dest++ = ((src[x] & 0xF) << 4) | (src[x + 1] & 0xF);
+
+        if (width % 2 != 0)
+            *dest = (src[width - 1] & 0xF) << 4;
+
+        return;
     }
 
-    return output;
+    int mask = (1 << (srcBitDepth < destBitDepth ? srcBitDepth : destBitDepth)) - 1;
+    long destPos = (long)firstPixel * destBitDepth;
+
+    for (int x = 0; x < width; x++)
+    {
+        int srcPos = x * srcBitDepth;
+        int pixel = (src[srcPos / 8] >> (8 - srcBitDepth - srcPos % 8)) & mask;
+
+        dest[destPos / 8] |= pixel << (8 - destBitDepth - destPos % 8);
+        destPos += destBitDepth;
+    }
 }
 
 void ReadPng(char *path, struct Image *image)
@@ -97,40 +96,67 @@ void ReadPng(char *path, struct Image *image)
     image->width = png_get_image_width(png_ptr, info_ptr);
     image->height = png_get_image_height(png_ptr, info_ptr);
 
-    int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+    bool convertBitDepth = bit_depth != image->bitDepth && image->tilemap.data.affine == NULL;
 
-    image->pixels = malloc(image->height * rowbytes);
+    if (convertBitDepth && bit_depth != 1 && bit_depth != 2 && bit_depth != 4 && bit_depth != 8)
+        FATAL_ERROR("Bit depth of image must be 1, 2, 4, or 8.\n");
 
-    if (image->pixels == NULL)
-        FATAL_ERROR("Failed to allocate pixel buffer.\n");
+    if (setjmp(png_jmpbuf(png_ptr)))
+        FATAL_ERROR("Error reading from \"%s\".\n", path);
 
-    png_bytepp row_pointers = malloc(image->height * sizeof(png_bytep));
+    int numPasses = png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
 
-    if (row_pointers == NULL)
-        FATAL_ERROR("Failed to allocate row pointers.\n");
+    int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
 
-    for (int i = 0; i < image->height; i++)
-        row_pointers[i] = (png_bytep)(image->pixels + (i * rowbytes));
+    if (!convertBitDepth)
+    {
+        image->pixels = malloc(image->height * rowbytes);
 
-    if (setjmp(png_jmpbuf(png_ptr)))
-        FATAL_ERROR("Error reading from \"%s\".\n", path);
+        if (image->pixels == NULL)
+            FATAL_ERROR("Failed to allocate pixel buffer.\n");
+
+        for (int pass = 0; pass < numPasses; pass++)
+        {
+            for (int i = 0; i < image->height; i++)
+                png_read_row(png_ptr, image->pixels + (i * rowbytes), NULL);
+        }
+    }
+    else
+    {
+        // Rows are packed into the image's bit depth as they are decoded, so
+        // only one of them is held at the source bit depth. An interlaced
+        // image has no finished rows until the last pass, so it's decoded
+        // whole first.
+        int numPixels = image->width * image->height;
+        int numRows = numPasses > 1 ? image->height : 1;
 
-    png_read_image(png_ptr, row_pointers);
+        image->pixels = calloc(((numPixels * image->bitDepth + 7) & ~7) / 8, 1);
 
-    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        unsigned char *rows = malloc(numRows * rowbytes);
 
-    free(row_pointers);
-    fclose(fp);
+        if (image->pixels == NULL || rows == NULL)
+            FATAL_ERROR("Failed to allocate pixel buffer.\n");
 
-    if (bit_depth != image->bitDepth && image->tilemap.data.affine == NULL)
-    {
-        unsigned char *src = image->pixels;
+        for (int pass = 0; pass < numPasses; pass++)
+        {
+            for (int i = 0; i < image->height; i++)
+            {
+                unsigned char *row = rows + (i % numRows) * rowbytes;
+
+                png_read_row(png_ptr, row, NULL);
+
+                if (pass == numPasses - 1)
+                    PackRow(row, bit_depth, image->pixels, image->bitDepth, i * image->width, image->width);
+            }
+        }
 
-        if (bit_depth != 1 && bit_depth != 2 && bit_depth != 4 && bit_depth != 8)
-            FATAL_ERROR("Bit depth of image must be 1, 2, 4, or 8.\n");
-        image->pixels = ConvertBitDepth(image->pixels, bit_depth, image->bitDepth, image->width * image->height);
-        free(src);
+        free(rows);
     }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+    fclose(fp);
 }
 
 void ReadPngPalette(char *path, struct Palette *palette)
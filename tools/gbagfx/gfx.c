@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "global.h"
 #include "gfx.h"
 #include "util.h"
@@ -36,6 +39,102 @@ static void AdvanceMetatilePosition(int *subTileX, int *subTileY, int *metatileX
 	}
 }
 
+// The 4bpp and 8bpp converters move whole tiles at a time. A tile row is
+// 4 or 8 contiguous bytes on both sides, so only the row pitch differs between
+// the tiled and the linear layout. For 4bpp the nibbles of every byte are
+// swapped, since the GBA stores the left pixel in the low nibble; inverting
+// colors is an XOR with 0xFF for either bit depth.
+
+#ifdef __SSE2__
+
+// Loads 16 bytes' worth of rows (four 4-byte rows or two 8-byte rows).
+static inline __m128i LoadTileRows(const unsigned char *src, int pitch, int rowSize)
+{
+	if (pitch == rowSize)
+		return _mm_loadu_si128((const __m128i *)src);
+
+	if (rowSize == 8)
+		return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)src), _mm_loadl_epi64((const __m128i *)(src + pitch)));
+
+	__m128i rows[4];
+
+	for (int i = 0; i < 4; i++) {
+		int32_t row;
+		memcpy(&row, &src[i * pitch], 4);
+		rows[i] = _mm_cvtsi32_si128(row);
+	}
+
+	return _mm_unpacklo_epi64(_mm_unpacklo_epi32(rows[0], rows[1]), _mm_unpacklo_epi32(rows[2], rows[3]));
+}
+
+static inline void StoreTileRows(unsigned char *dest, int pitch, int rowSize, __m128i rows)
+{
+	if (pitch == rowSize) {
+		_mm_storeu_si128((__m128i *)dest, rows);
+	} else if (rowSize == 8) {
+		_mm_storel_epi64((__m128i *)dest, rows);
+		_mm_storel_epi64((__m128i *)(dest + pitch), _mm_unpackhi_epi64(rows, rows));
+	} else {
+		for (int i = 0; i < 4; i++) {
+			int32_t row = _mm_cvtsi128_si32(rows);
+			memcpy(&dest[i * pitch], &row, 4);
+			rows = _mm_srli_si128(rows, 4);
+		}
+	}
+}
+
+static void ConvertTile4Bpp(const unsigned char *src, int srcPitch, unsigned char *dest, int destPitch, bool invertColors)
+{
+	const __m128i lowNibbles = _mm_set1_epi8(0x0F);
+	const __m128i invertMask = _mm_set1_epi8(invertColors ? 0xFF : 0);
+
+	for (int j = 0; j < 8; j += 4) {
+		__m128i rows = LoadTileRows(&src[j * srcPitch], srcPitch, 4);
+		__m128i low = _mm_slli_epi16(_mm_and_si128(rows, lowNibbles), 4);
+		__m128i high = _mm_and_si128(_mm_srli_epi16(rows, 4), lowNibbles);
+		rows = _mm_xor_si128(_mm_or_si128(low, high), invertMask);
+		StoreTileRows(&dest[j * destPitch], destPitch, 4, rows);
+	}
+}
+
+static void ConvertTile8Bpp(const unsigned char *src, int srcPitch, unsigned char *dest, int destPitch, bool invertColors)
+{
+	const __m128i invertMask = _mm_set1_epi8(invertColors ? 0xFF : 0);
+
+	for (int j = 0; j < 8; j += 2) {
+		__m128i rows = LoadTileRows(&src[j * srcPitch], srcPitch, 8);
+		StoreTileRows(&dest[j * destPitch], destPitch, 8, _mm_xor_si128(rows, invertMask));
+	}
+}
+
+#else
+
+static void ConvertTile4Bpp(const unsigned char *src, int srcPitch, unsigned char *dest, int destPitch, bool invertColors)
+{
+	uint32_t invertMask = invertColors ? 0xFFFFFFFF : 0;
+
+	for (int j = 0; j < 8; j++) {
+		uint32_t row;
+		memcpy(&row, &src[j * srcPitch], 4);
+		row = (((row & 0x0F0F0F0F) << 4) | ((row >> 4) & 0x0F0F0F0F)) ^ invertMask;
+		memcpy(&dest[j * destPitch], &row, 4);
+	}
+}
+
+static void ConvertTile8Bpp(const unsigned char *src, int srcPitch, unsigned char *dest, int destPitch, bool invertColors)
+{
+	uint64_t invertMask = invertColors ? UINT64_MAX : 0;
+
+	for (int j = 0; j < 8; j++) {
+		uint64_t row;
+		memcpy(&row, &src[j * srcPitch], 8);
+		row ^= invertMask;
+		memcpy(&dest[j * destPitch], &row, 8);
+	}
+}
+
+#endif // __SSE2__
+
 static void ConvertFromTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
 {
 	int subTileX = 0;
@@ -71,23 +170,11 @@ static void ConvertFromTiles4Bpp(unsigned char *src, unsigned char *dest, int nu
 	int pitch = (metatilesWide * metatileWidth) * 4;
 
 	for (int i = 0; i < numTiles; i++) {
-		for (int j = 0; j < 8; j++) {
-			int destY = (metatileY * metatileHeight + subTileY) * 8 + j;
+		int destY = (metatileY * metatileHeight + subTileY) * 8;
+		int destX = (metatileX * metatileWidth + subTileX) * 4;
 
-			for (int k = 0; k < 4; k++) {
-				int destX = (metatileX * metatileWidth + subTileX) * 4 + k;
-				unsigned char srcPixelPair = *src++;
-				unsigned char leftPixel = srcPixelPair & 0xF;
-				unsigned char rightPixel = srcPixelPair >> 4;
-
-				if (invertColors) {
-					leftPixel = 15 - leftPixel;
-					rightPixel = 15 - rightPixel;
-				}
-
-				dest[destY * pitch + destX] = (leftPixel << 4) | rightPixel;
-			}
-		}
+		ConvertTile4Bpp(src, 4, &dest[destY * pitch + destX], pitch, invertColors);
+		src += 32;
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
 	}
@@ -102,19 +189,11 @@ static void ConvertFromTiles8Bpp(unsigned char *src, unsigned char *dest, int nu
 	int pitch = (metatilesWide * metatileWidth) * 8;
 
 	for (int i = 0; i < numTiles; i++) {
-		for (int j = 0; j < 8; j++) {
-			int destY = (metatileY * metatileHeight + subTileY) * 8 + j;
-
-			for (int k = 0; k < 8; k++) {
-				int destX = (metatileX * metatileWidth + subTileX) * 8 + k;
-				unsigned char srcPixel = *src++;
-
-				if (invertColors)
-					srcPixel = 255 - srcPixel;
+		int destY = (metatileY * metatileHeight + subTileY) * 8;
+		int destX = (metatileX * metatileWidth + subTileX) * 8;
 
-				dest[destY * pitch + destX] = srcPixel;
-			}
-		}
+		ConvertTile8Bpp(src, 8, &dest[destY * pitch + destX], pitch, invertColors);
+		src += 64;
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
 	}
@@ -155,23 +234,11 @@ static void ConvertToTiles4Bpp(unsigned char *src, unsigned char *dest, int numT
 	int pitch = (metatilesWide * metatileWidth) * 4;
 
 	for (int i = 0; i < numTiles; i++) {
-		for (int j = 0; j < 8; j++) {
-			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
+		int srcY = (metatileY * metatileHeight + subTileY) * 8;
+		int srcX = (metatileX * metatileWidth + subTileX) * 4;
 
-			for (int k = 0; k < 4; k++) {
-				int srcX = (metatileX * metatileWidth + subTileX) * 4 + k;
-				unsigned char srcPixelPair = src[srcY * pitch + srcX];
-				unsigned char leftPixel = srcPixelPair >> 4;
-				unsigned char rightPixel = srcPixelPair & 0xF;
-
-				if (invertColors) {
-					leftPixel = 15 - leftPixel;
-					rightPixel = 15 - rightPixel;
-				}
-
-				*dest++ = (rightPixel << 4) | leftPixel;
-			}
-		}
+		ConvertTile4Bpp(&src[srcY * pitch + srcX], pitch, dest, 4, invertColors);
+		dest += 32;
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
 	}
@@ -186,19 +253,11 @@ static void ConvertToTiles8Bpp(unsigned char *src, unsigned char *dest, int numT
 	int pitch = (metatilesWide * metatileWidth) * 8;
 
 	for (int i = 0; i < numTiles; i++) {
-		for (int j = 0; j < 8; j++) {
-			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
-
-			for (int k = 0; k < 8; k++) {
-				int srcX = (metatileX * metatileWidth + subTileX) * 8 + k;
-				unsigned char srcPixel = src[srcY * pitch + srcX];
-
-				if (invertColors)
-					srcPixel = 255 - srcPixel;
+		int srcY = (metatileY * metatileHeight + subTileY) * 8;
+		int srcX = (metatileX * metatileWidth + subTileX) * 8;
 
-				*dest++ = srcPixel;
-			}
-		}
+		ConvertTile8Bpp(&src[srcY * pitch + srcX], pitch, dest, 8, invertColors);
+		dest += 64;
 
 		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
 	}
@@ -357,6 +416,108 @@ static unsigned char *DecodeTilemap(unsigned char *tiles, struct Tilemap *tilema
     return decoded;
 }
 
+static uint32_t HashTile(unsigned char *tile, int tileSize)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < tileSize; i++)
+        hash = (hash ^ tile[i]) * 16777619u;
+    return hash;
+}
+
+// Returns the index of the unique tile equal to tile, or -1 after pointing
+// *slot at the empty hash table slot where it belongs.
+static int FindTile(unsigned char *uniqueTiles, int *table, int tableMask, unsigned char *tile, int tileSize, int **slot)
+{
+    int i = HashTile(tile, tileSize) & tableMask;
+    while (table[i] >= 0)
+    {
+        if (memcmp(&uniqueTiles[table[i] * tileSize], tile, tileSize) == 0)
+            return table[i];
+        i = (i + 1) & tableMask;
+    }
+    *slot = &table[i];
+    return -1;
+}
+
+// Removes repeated tiles from tiles in place and returns the tilemap that
+// places the remaining ones back in the original order. Non-affine maps also
+// match tiles against the horizontally and/or vertically flipped versions of
+// earlier tiles. *numTiles is updated to the number of unique tiles.
+unsigned char *BuildTilemap(unsigned char *tiles, int *numTiles, int bitDepth, bool isAffine, int *tilemapSize)
+{
+    int tileSize = bitDepth * 8;
+    int mapTileSize = isAffine ? 1 : 2;
+    int maxUniqueTiles = isAffine ? 256 : 1024;
+    int numFlips = isAffine ? 1 : 4;
+    int tableSize = 1;
+
+    while (tableSize < *numTiles * 2)
+        tableSize <<= 1;
+
+    int *table = malloc(tableSize * sizeof(int));
+    unsigned char *tilemap = malloc(*numTiles * mapTileSize + 1);
+
+    if (table == NULL || tilemap == NULL)
+        FATAL_ERROR("Failed to allocate memory for tilemap.\n");
+
+    memset(table, -1, tableSize * sizeof(int));
+
+    int numUniqueTiles = 0;
+
+    for (int i = 0; i < *numTiles; i++)
+    {
+        unsigned char *tile = &tiles[i * tileSize];
+        int *slot;
+        int index = FindTile(tiles, table, tableSize - 1, tile, tileSize, &slot);
+        int flip = 0;
+
+        // Bit 0 of flip is a horizontal flip and bit 1 a vertical flip.
+        for (int f = 1; f < numFlips && index < 0; f++)
+        {
+            unsigned char flipped[64];
+            int *unusedSlot;
+
+            memcpy(flipped, tile, tileSize);
+            if (f & 1)
+                HflipTile(flipped, bitDepth);
+            if (f & 2)
+                VflipTile(flipped, bitDepth);
+            index = FindTile(tiles, table, tableSize - 1, flipped, tileSize, &unusedSlot);
+            flip = f;
+        }
+
+        if (index < 0)
+        {
+            if (numUniqueTiles == maxUniqueTiles)
+                FATAL_ERROR("The image has more unique tiles than a tilemap can refer to (%d).\n", maxUniqueTiles);
+
+            memmove(&tiles[numUniqueTiles * tileSize], tile, tileSize);
+            *slot = numUniqueTiles;
+            index = numUniqueTiles++;
+            flip = 0;
+        }
+
+        if (isAffine)
+        {
+            tilemap[i] = index;
+        }
+        else
+        {
+            struct NonAffineTile *entry = (struct NonAffineTile *)&tilemap[i * 2];
+            entry->index = index;
+            entry->hflip = flip & 1;
+            entry->vflip = (flip >> 1) & 1;
+            entry->palno = 0;
+        }
+    }
+
+    free(table);
+
+    *tilemapSize = *numTiles * mapTileSize;
+    *numTiles = numUniqueTiles;
+    return tilemap;
+}
+
 void ReadTileImage(char *path, int tilesWidth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
 {
 	int tileSize = image->bitDepth * 8;
@@ -408,7 +569,7 @@ void ReadTileImage(char *path, int tilesWidth, int metatileWidth, int metatileHe
 	free(buffer);
 }
 
-void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+unsigned char *ConvertToTileImage(enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors, int *size)
 {
 	int tileSize = image->bitDepth * 8;
 
@@ -474,7 +635,16 @@ void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, in
 		}
 	}
 
-	WriteWholeFile(path, buffer, zeroPadded ? bufferSize : maxBufferSize);
+	*size = zeroPadded ? bufferSize : maxBufferSize;
+	return buffer;
+}
+
+void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+{
+	int bufferSize;
+	unsigned char *buffer = ConvertToTileImage(numTilesMode, numTiles, metatileWidth, metatileHeight, image, invertColors, &bufferSize);
+
+	WriteWholeFile(path, buffer, bufferSize);
 
 	free(buffer);
 }
@@ -505,7 +675,7 @@ void ReadPlainImage(char *path, int dataWidth, struct Image *image, bool invertC
 	free(buffer);
 }
 
-void WritePlainImage(char *path, int dataWidth, struct Image *image, bool invertColors)
+unsigned char *ConvertToPlainImage(int dataWidth, struct Image *image, bool invertColors, int *size)
 {
 	int bufferSize = image->width * image->height * image->bitDepth / 8;
 
@@ -525,6 +695,15 @@ void WritePlainImage(char *path, int dataWidth, struct Image *image, bool invert
 
 	CopyPlainPixels(image->pixels, buffer, bufferSize, dataWidth, invertColors);
 
+	*size = bufferSize;
+	return buffer;
+}
+
+void WritePlainImage(char *path, int dataWidth, struct Image *image, bool invertColors)
+{
+	int bufferSize;
+	unsigned char *buffer = ConvertToPlainImage(dataWidth, image, invertColors, &bufferSize);
+
 	WriteWholeFile(path, buffer, bufferSize);
 
 	free(buffer);
@@ -567,12 +746,12 @@ void ReadGbaPalette(char *path, struct Palette *palette)
 	free(data);
 }
 
-void WriteGbaPalette(char *path, struct Palette *palette)
+unsigned char *ConvertToGbaPalette(struct Palette *palette, int *size)
 {
-	FILE *fp = fopen(path, "wb");
+	unsigned char *buffer = malloc(palette->numColors * 2 + 1);
 
-	if (fp == NULL)
-		FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
+	if (buffer == NULL)
+		FATAL_ERROR("Failed to allocate memory for palette.\n");
 
 	for (int i = 0; i < palette->numColors; i++) {
 		unsigned char red = DOWNCONVERT_BIT_DEPTH(palette->colors[i].red);
@@ -581,9 +760,20 @@ void WriteGbaPalette(char *path, struct Palette *palette)
 
 		uint16_t paletteEntry = SET_GBA_PAL(red, green, blue);
 
-		fputc(paletteEntry & 0xFF, fp);
-		fputc(paletteEntry >> 8, fp);
+		buffer[i * 2] = paletteEntry & 0xFF;
+		buffer[i * 2 + 1] = paletteEntry >> 8;
 	}
 
-	fclose(fp);
+	*size = palette->numColors * 2;
+	return buffer;
+}
+
+void WriteGbaPalette(char *path, struct Palette *palette)
+{
+	int bufferSize;
+	unsigned char *buffer = ConvertToGbaPalette(palette, &bufferSize);
+
+	WriteWholeFile(path, buffer, bufferSize);
+
+	free(buffer);
 }
@@ -51,11 +51,15 @@ enum NumTilesMode {
 };
 
 void ReadTileImage(char *path, int tilesWidth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
+unsigned char *ConvertToTileImage(enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors, int *size);
+unsigned char *BuildTilemap(unsigned char *tiles, int *numTiles, int bitDepth, bool isAffine, int *tilemapSize);
 void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
 void ReadPlainImage(char *path, int dataWidth, struct Image *image, bool invertColors);
+unsigned char *ConvertToPlainImage(int dataWidth, struct Image *image, bool invertColors, int *size);
 void WritePlainImage(char *path, int dataWidth, struct Image *image, bool invertColors);
 void FreeImage(struct Image *image);
 void ReadGbaPalette(char *path, struct Palette *palette);
+unsigned char *ConvertToGbaPalette(struct Palette *palette, int *size);
 void WriteGbaPalette(char *path, struct Palette *palette);
 
 #endif // GFX_H
@@ -8,20 +8,24 @@
 
 #ifdef _MSC_VER
 
+__declspec(noreturn) void ExitOnError(void);
+
 #define FATAL_ERROR(format, ...)          \
 do {                                      \
     fprintf(stderr, format, __VA_ARGS__); \
-    exit(1);                              \
+    ExitOnError();                        \
 } while (0)
 
 #define UNUSED
 
 #else
 
+_Noreturn void ExitOnError(void);
+
 #define FATAL_ERROR(format, ...)            \
 do {                                        \
     fprintf(stderr, format, ##__VA_ARGS__); \
-    exit(1);                                \
+    ExitOnError();                          \
 } while (0)
 
 #define UNUSED __attribute__((__unused__))
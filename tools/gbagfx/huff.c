@@ -6,209 +6,263 @@
 #include "global.h"
 #include "huff.h"
 
-static int cmp_tree(const void * a0, const void * b0) {
-    return ((struct HuffData *)a0)->value - ((struct HuffData *)b0)->value;
+// The tree is built by repeatedly merging the two least frequent nodes, kept in
+// a binary min-heap. Ties go to the node with the lower index: leaves come
+// first, in key order, followed by branches in the order they were created.
+static bool node_less(HuffNode_t * nodes, int a, int b) {
+    if (nodes[a].header.value != nodes[b].header.value)
+        return nodes[a].header.value < nodes[b].header.value;
+    return a < b;
 }
 
-typedef int (*cmpfun)(const void *, const void *);
+static void heap_push(int * heap, int * heapSize, HuffNode_t * nodes, int node) {
+    int i = (*heapSize)++;
 
-int msort_r(void * data, size_t count, size_t size, cmpfun cmp, void * buffer) {
-    /*
-     * Out-of-place mergesort (stable sort)
-     * Returns 1 on success, 0 on failure
-     */
-    void * leftPtr;
-    void * rightPtr;
-    void * leftEnd;
-    void * rightEnd;
-    int i;
-
-    switch (count) {
-    case 0:
-        // Should never be here
-        return 0;
-
-    case 1:
-        // Nothing to do here
-        break;
-
-    case 2:
-        // Swap the two entries if the right one compares higher.
-        if (cmp(data, data + size) > 0) {
-            memcpy(buffer, data, size);
-            memcpy(data, data + size, size);
-            memcpy(data + size, buffer, size);
-        }
-        break;
-    default:
-        // Merge sort out-of-place.
-        leftPtr = data;
-        leftEnd = rightPtr = data + count / 2 * size;
-        rightEnd = data + count * size;
-
-        // Sort the left half
-        if (!msort_r(leftPtr, count / 2, size, cmp, buffer))
-            return 0;
-
-        // Sort the right half
-        if (!msort_r(rightPtr, count / 2 + (count & 1), size, cmp, buffer))
-            return 0;
-
-        // Merge the sorted halves out of place
-        i = 0;
-        do {
-            if (cmp(leftPtr, rightPtr) <= 0) {
-                memcpy(buffer + i * size, leftPtr, size);
-                leftPtr += size;
-            } else {
-                memcpy(buffer + i * size, rightPtr, size);
-                rightPtr += size;
-            }
+    while (i > 0 && node_less(nodes, node, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = node;
+}
 
-        } while (++i < count && leftPtr < leftEnd && rightPtr < rightEnd);
+static int heap_pop(int * heap, int * heapSize, HuffNode_t * nodes) {
+    int top = heap[0];
+    int last = heap[--(*heapSize)];
+    int i = 0;
 
-        // Copy the remainder
-        if (i < count) {
-            if (leftPtr < leftEnd) {
-                memcpy(buffer + i * size, leftPtr, leftEnd - leftPtr);
-            }
-            else {
-                memcpy(buffer + i * size, rightPtr, rightEnd - rightPtr);
+    for (;;) {
+        int child = i * 2 + 1;
+        if (child >= *heapSize)
+            break;
+        if (child + 1 < *heapSize && node_less(nodes, heap[child + 1], heap[child]))
+            child++;
+        if (!node_less(nodes, heap[child], last))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+// A branch can point at most 64 pairs of nodes ahead, so the children of a
+// branch in pair position p have to be placed by position p + 64. The root
+// counts as being at position -1.
+#define MAX_PAIR_DISTANCE 64
+
+// Returns whether the branches in pending, other than pending[skip] and plus
+// count new ones due at newDeadline, can all have their children placed on
+// time starting at position pos.
+static bool can_meet_deadlines(int * deadline, int * pending, int npending, int skip, int count, int newDeadline, int pos) {
+    int due[MAX_PAIR_DISTANCE + 1] = {0};
+
+    for (int i = 0; i < npending; i++) {
+        if (i == skip)
+            continue;
+        if (deadline[pending[i]] < pos)
+            return false;
+        due[deadline[pending[i]] - pos]++;
+    }
+    if (count > 0)
+        due[newDeadline - pos] += count;
+
+    int total = 0;
+    for (int i = 0; i <= MAX_PAIR_DISTANCE; i++) {
+        total += due[i];
+        if (total > i + 1)
+            return false;
+    }
+    return true;
+}
+
+// Lays out a tree that is too wide to be written breadth-first. Each position
+// takes the children of the branch placed most recently, like a depth-first
+// layout, unless that would leave an earlier branch unable to reach its
+// children; then the branch with the nearest deadline goes first.
+static bool layout_wide_tree(HuffNode_t ** nodes, int * childPair, int * pairPos, int * pairAt, int nnodes, int npairs) {
+    int * pending = malloc(nnodes * sizeof(int));
+    int * deadline = malloc(nnodes * sizeof(int));
+    if (pending == NULL || deadline == NULL)
+        FATAL_ERROR("Fatal error while compressing Huff file.\n");
+
+    int npending = 1;
+    pending[0] = 0;
+    deadline[0] = MAX_PAIR_DISTANCE - 1;
+
+    bool success = true;
+    for (int pos = 0; pos < npairs && success; pos++) {
+        int pick = npending - 1;
+        int pair = childPair[pending[pick]];
+        int newBranches = !nodes[2 * pair + 1]->header.isLeaf + !nodes[2 * pair + 2]->header.isLeaf;
+
+        if (!can_meet_deadlines(deadline, pending, npending, pick, newBranches, pos + MAX_PAIR_DISTANCE, pos + 1)) {
+            for (int i = 0; i < npending; i++) {
+                if (deadline[pending[i]] < deadline[pending[pick]])
+                    pick = i;
             }
+            pair = childPair[pending[pick]];
         }
 
-        // Copy the merged data back
-        memcpy(data, buffer, count * size);
-        break;
-    }
+        if (deadline[pending[pick]] < pos) {
+            success = false;
+            break;
+        }
 
-    return 1;
-}
+        memmove(&pending[pick], &pending[pick + 1], (npending - pick - 1) * sizeof(int));
+        npending--;
+
+        pairAt[pos] = pair;
+        pairPos[pair] = pos;
+        for (int i = 1; i <= 2; i++) {
+            if (!nodes[2 * pair + i]->header.isLeaf) {
+                pending[npending++] = 2 * pair + i;
+                deadline[2 * pair + i] = pos + MAX_PAIR_DISTANCE;
+            }
+        }
+    }
 
-int msort(void * data, size_t count, size_t size, cmpfun cmp) {
-    void * buffer = malloc(count * size);
-    if (buffer == NULL) return 0;
-    int result = msort_r(data, count, size, cmp, buffer);
-    free(buffer);
-    return result;
+    free(deadline);
+    free(pending);
+    return success;
 }
 
 static void write_tree(unsigned char * dest, HuffNode_t * tree, int nitems, struct BitEncoding * encoding) {
     /*
-     * The example used to guide this function encodes the tree in a
-     * breadth-first manner.  We attempt to emulate that here.
+     * The tree is encoded breadth-first: the root comes first, followed by
+     * pairs of nodes which are the children of one branch each. Trees too
+     * wide for that are laid out by layout_wide_tree instead.
      */
 
-    int i, j, k;
-
-    // There are (2 * nitems - 1) nodes in the binary tree.  Allocate that.
-    HuffNode_t * traversal = calloc(2 * nitems - 1, sizeof(HuffNode_t));
-    if (traversal == NULL)
+    int nnodes = 2 * nitems - 1;
+    int npairs = nitems - 1;
+    HuffNode_t ** nodes = malloc(nnodes * sizeof(HuffNode_t *));
+    struct BitEncoding * paths = malloc(nnodes * sizeof(struct BitEncoding));
+    int * childPair = malloc(nnodes * sizeof(int));
+    int * pairPos = malloc(nitems * sizeof(int));
+    int * pairAt = malloc(nitems * sizeof(int));
+    if (nodes == NULL || paths == NULL || childPair == NULL || pairPos == NULL || pairAt == NULL)
         FATAL_ERROR("Fatal error while compressing Huff file.\n");
 
-    // The first node is the root of the tree.
-    traversal[0] = *tree;
-    i = 1;
-
-    // Copy the tree into a breadth-first ordering using brute force.
-    for (int depth = 1; i < 2 * nitems - 1; depth++) {
-        // Consider every possible path up to the current depth.
-        for (j = 0; i < 2 * nitems - 1 && j < 1 << depth; j++) {
-            // The index of the path is used to encode the path itself.
-            // Start from the most significant relevant bit and work our way down.
-            // Keep track of the current and previous nodes.
-            HuffNode_t * currNode = traversal;
-            HuffNode_t * parent = NULL;
-            for (k = 0; k < depth; k++) {
-                if (currNode->header.isLeaf)
-                    break;
-                parent = currNode;
-                if ((j >> (depth - k - 1)) & 1)
-                    currNode = currNode->branch.right;
-                else
-                    currNode = currNode->branch.left;
-            }
-            // Check that the length of the current path equals the current depth.
-            if (k == depth) {
-                // Make sure we can encode the current branch.
-                // Bail here if we cannot.
-                // This is only applicable for 8-bit encodings.
-                if (traversal + i - parent > 128)
-                    FATAL_ERROR("Fatal error while compressing Huff file: unable to encode binary tree.\n");
-                // Copy the current node, and update its parent.
-                traversal[i] = *currNode;
-                if (parent != NULL) {
-                    if ((j & 1) == 1)
-                        parent->branch.right = traversal + i;
-                    else
-                        parent->branch.left = traversal + i;
-                }
-                // Encode the path through the tree in the lookup table
-                if (traversal[i].header.isLeaf) {
-                    encoding[traversal[i].leaf.key].nbits = depth;
-                    encoding[traversal[i].leaf.key].bitstring = j;
-                }
-                i++;
+    nodes[0] = tree;
+    paths[0].nbits = 0;
+    paths[0].bitstring = 0;
+    int nqueued = 1;
+
+    for (int i = 0; i < nnodes; i++) {
+        HuffNode_t * currNode = nodes[i];
+        if (currNode->header.isLeaf) {
+            // Encode the path through the tree in the lookup table
+            if (paths[i].nbits > 32)
+                FATAL_ERROR("Fatal error while compressing Huff file: code too long.\n");
+            encoding[currNode->leaf.key] = paths[i];
+        } else {
+            childPair[i] = nqueued / 2;
+            pairPos[nqueued / 2] = pairAt[nqueued / 2] = nqueued / 2;
+            for (int bit = 0; bit < 2; bit++) {
+                nodes[nqueued] = bit ? currNode->branch.right : currNode->branch.left;
+                paths[nqueued].nbits = paths[i].nbits + 1;
+                paths[nqueued].bitstring = (paths[i].bitstring << 1) | bit;
+                nqueued++;
             }
         }
     }
 
+    // Keep the breadth-first layout unless some branch can't reach its children.
+    bool fitsBreadthFirst = true;
+    for (int i = 0; i < nnodes; i++) {
+        int pos = i == 0 ? -1 : (i - 1) / 2;
+        if (!nodes[i]->header.isLeaf && childPair[i] > pos + MAX_PAIR_DISTANCE)
+            fitsBreadthFirst = false;
+    }
+
+    if (!fitsBreadthFirst && !layout_wide_tree(nodes, childPair, pairPos, pairAt, nnodes, npairs))
+        FATAL_ERROR("Fatal error while compressing Huff file: unable to encode binary tree.\n");
+
     // Encode the size of the tree.
-    // This is used by the decompressor to skip the tree.
-    dest[4] = nitems - 1;
+    // This is used by the decompressor to skip the tree. It counts pairs of
+    // bytes, including the size byte itself, and is padded so that the
+    // bitstream after the tree stays word-aligned.
+    dest[4] = (nitems - 1) | 1;
+    memset(dest + 5 + nnodes, 0, (dest[4] + 1) * 2 - 1 - nnodes);
 
     // Encode each node in the tree.
-    for (i = 0; i < 2 * nitems - 1; i++) {
-        HuffNode_t * currNode = traversal + i;
-        if (currNode->header.isLeaf) {
-            dest[5 + i] = traversal[i].leaf.key;
-        } else {
-            dest[5 + i] = (((currNode->branch.right - traversal - i) / 2) - 1);
-            if (currNode->branch.left->header.isLeaf)
-                dest[5 + i] |= 0x80;
-            if (currNode->branch.right->header.isLeaf)
-                dest[5 + i] |= 0x40;
+    for (int pos = -1; pos < npairs; pos++) {
+        for (int i = 0; i < (pos < 0 ? 1 : 2); i++) {
+            int node = pos < 0 ? 0 : 2 * pairAt[pos] + 1 + i;
+            unsigned char * out = pos < 0 ? &dest[5] : &dest[6 + 2 * pos + i];
+            HuffNode_t * currNode = nodes[node];
+            if (currNode->header.isLeaf) {
+                *out = currNode->leaf.key;
+            } else {
+                *out = pairPos[childPair[node]] - pos - 1;
+                if (currNode->branch.left->header.isLeaf)
+                    *out |= 0x80;
+                if (currNode->branch.right->header.isLeaf)
+                    *out |= 0x40;
+            }
         }
     }
 
-    free(traversal);
+    free(pairAt);
+    free(pairPos);
+    free(childPair);
+    free(paths);
+    free(nodes);
 }
 
-static inline void write_32_le(unsigned char * dest, int * destPos, uint32_t * buff, int * buffPos) {
-    dest[*destPos] = *buff;
-    dest[*destPos + 1] = *buff >> 8;
-    dest[*destPos + 2] = *buff >> 16;
-    dest[*destPos + 3] = *buff >> 24;
+static inline void write_32_le(unsigned char * dest, int * destPos, uint32_t value) {
+    dest[*destPos] = value;
+    dest[*destPos + 1] = value >> 8;
+    dest[*destPos + 2] = value >> 16;
+    dest[*destPos + 3] = value >> 24;
     *destPos += 4;
-    *buff = 0;
-    *buffPos = 0;
 }
 
-static inline void read_32_le(unsigned char * src, int * srcPos, uint32_t * buff) {
+static inline uint32_t read_32_le(unsigned char * src, int * srcPos) {
     uint32_t tmp = src[*srcPos];
     tmp |= src[*srcPos + 1] << 8;
     tmp |= src[*srcPos + 2] << 16;
-    tmp |= src[*srcPos + 3] << 24;
+    tmp |= (uint32_t)src[*srcPos + 3] << 24;
     *srcPos += 4;
-    *buff = tmp;
+    return tmp;
 }
 
-static void write_bits(unsigned char * dest, int * destPos, struct BitEncoding * encoding, int value, uint32_t * buff, int * buffBits) {
-    int nbits = encoding[value].nbits;
-    uint32_t bitstring = encoding[value].bitstring;
-
-    if (*buffBits + nbits >= 32) {
-        int diff = *buffBits + nbits - 32;
-        *buff <<= nbits - diff;
-        *buff |= bitstring >> diff;
-        bitstring &= ~(1 << diff);
-        nbits = diff;
-        write_32_le(dest, destPos, buff, buffBits);
-    }
-    if (nbits != 0) {
-        *buff <<= nbits;
-        *buff |= bitstring;
-        *buffBits += nbits;
+/*
+ * The decompressor looks up the next LOOKUP_BITS bits of the bitstream in a
+ * table built from the tree. Codes that are no longer than that decode in a
+ * single step; longer ones continue down the tree from where the table left
+ * off, one bit at a time.
+ */
+#define LOOKUP_BITS 10
+
+struct LookupEntry {
+    uint16_t value; // The decoded value, or the tree position to continue from
+    uint8_t nbits;
+    bool isLeaf;
+};
+
+static void fill_lookup_table(unsigned char * src, int srcSize, struct LookupEntry * table, int treePos, int path, int depth) {
+    unsigned char treeView = src[treePos];
+    int childPos = (treePos & ~1) + ((treeView & 0x3F) + 1) * 2;
+
+    if (childPos + 1 >= srcSize)
+        FATAL_ERROR("Fatal error while decompressing Huff file.\n");
+
+    for (int bit = 0; bit < 2; bit++) {
+        int childPath = (path << 1) | bit;
+        int childDepth = depth + 1;
+
+        if (treeView & (0x80 >> bit)) {
+            int shift = LOOKUP_BITS - childDepth;
+            struct LookupEntry entry = { src[childPos + bit], childDepth, true };
+            for (int i = 0; i < 1 << shift; i++)
+                table[(childPath << shift) + i] = entry;
+        } else if (childDepth == LOOKUP_BITS) {
+            struct LookupEntry entry = { childPos + bit, childDepth, false };
+            table[childPath] = entry;
+        } else {
+            fill_lookup_table(src, srcSize, table, childPos + bit, childPath, childDepth);
+        }
     }
 }
 
@@ -222,110 +276,109 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
     if (srcSize <= 0)
         goto fail;
 
-    int worstCaseDestSize = 4 + (2 << bitDepth) + srcSize * 3;
+    // Codes are at most 32 bits long, and the tree takes up to 2 * nkeys bytes.
+    int nkeys = 1 << bitDepth;
+    int worstCaseDestSize = 4 + 2 * nkeys + 2 + srcSize * 4 + 4;
 
     unsigned char *dest = malloc(worstCaseDestSize);
     if (dest == NULL)
         goto fail;
 
-    int nitems = 1 << bitDepth;
+    HuffNode_t * nodes = calloc(2 * nkeys, sizeof(HuffNode_t));
+    if (nodes == NULL)
+        goto fail;
 
-    HuffNode_t * freqs = calloc(nitems, sizeof(HuffNode_t));
-    if (freqs == NULL)
+    int * heap = malloc(nkeys * sizeof(int));
+    if (heap == NULL)
         goto fail;
 
-    struct BitEncoding * encoding = calloc(nitems, sizeof(struct BitEncoding));
+    struct BitEncoding * encoding = calloc(nkeys, sizeof(struct BitEncoding));
     if (encoding == NULL)
         goto fail;
 
-    // Set up the frequencies table.  This will inform the tree.
-    for (int i = 0; i < nitems; i++) {
-        freqs[i].header.isLeaf = 1;
-        freqs[i].header.value = 0;
-        freqs[i].leaf.key = i;
-    }
-
     // Count each nybble or byte.
+    int freqs[256] = {0};
+    int nvalues = srcSize * 8 / bitDepth;
+
     for (int i = 0; i < srcSize; i++) {
         if (bitDepth == 8) {
-            freqs[src[i]].header.value++;
+            freqs[src[i]]++;
         } else {
-            freqs[src[i] >> 4].header.value++;
-            freqs[src[i] & 0xF].header.value++;
+            freqs[src[i] >> 4]++;
+            freqs[src[i] & 0xF]++;
         }
     }
 
 #ifdef DEBUG
-    for (int i = 0; i < nitems; i++) {
-        fprintf(stderr, "%d: %d\n", i, freqs[i].header.value);
+    for (int i = 0; i < nkeys; i++) {
+        fprintf(stderr, "%d: %d\n", i, freqs[i]);
     }
 #endif // DEBUG
 
-    // Sort the frequency table.
-    if (!msort(freqs, nitems, sizeof(HuffNode_t), cmp_tree))
-        goto fail;
+    // Make a leaf for each value that occurs.
+    int nitems = 0;
 
-    // Prune zero-frequency values.
-    for (int i = 0; i < nitems; i++) {
-        if (freqs[i].header.value != 0) {
-            if (i > 0) {
-                for (int j = i; j < nitems; j++) {
-                    freqs[j - i] = freqs[j];
-                }
-                nitems -= i;
-            }
-            break;
+    for (int i = 0; i < nkeys; i++) {
+        if (freqs[i] != 0) {
+            nodes[nitems].header.isLeaf = 1;
+            nodes[nitems].header.value = freqs[i];
+            nodes[nitems].leaf.key = i;
+            nitems++;
         }
-        // This should never happen:
-        if (i == nitems - 1)
-            goto fail;
     }
 
-    HuffNode_t * tree = calloc(nitems * 2 - 1, sizeof(HuffNode_t));
-    if (tree == NULL)
-        goto fail;
+    // A tree needs two leaves, so pair a lone value with one that never occurs.
+    if (nitems == 1) {
+        nodes[1] = nodes[0];
+        nodes[0].header.value = 0;
+        nodes[0].leaf.key = nodes[1].leaf.key == 0 ? 1 : 0;
+        nitems++;
+    }
 
-    // Iteratively collapse the two least frequent nodes.
-    HuffNode_t * endptr = freqs + nitems - 2;
-
-    for (int i = 0; i < nitems - 1; i++) {
-        HuffNode_t * left = freqs;
-        HuffNode_t * right = freqs + 1;
-        tree[i * 2] = *right;
-        tree[i * 2 + 1] = *left;
-        for (int j = 0; j < nitems - i - 2; j++)
-            freqs[j] = freqs[j + 2];
-        endptr->header.isLeaf = 0;
-        endptr->header.value = tree[i * 2].header.value + tree[i * 2 + 1].header.value;
-        endptr->branch.left = tree + i * 2;
-        endptr->branch.right = tree + i * 2 + 1;
-        endptr--;
-        if (i < nitems - 2 && !msort(freqs, nitems - i - 1, sizeof(HuffNode_t), cmp_tree))
-            goto fail;
+    // Iteratively collapse the two least frequent nodes. The least frequent
+    // one becomes the right branch.
+    int heapSize = 0;
+    int nnodes = nitems;
+
+    for (int i = 0; i < nitems; i++)
+        heap_push(heap, &heapSize, nodes, i);
+
+    while (heapSize > 1) {
+        int right = heap_pop(heap, &heapSize, nodes);
+        int left = heap_pop(heap, &heapSize, nodes);
+        nodes[nnodes].header.isLeaf = 0;
+        nodes[nnodes].header.value = nodes[left].header.value + nodes[right].header.value;
+        nodes[nnodes].branch.left = &nodes[left];
+        nodes[nnodes].branch.right = &nodes[right];
+        heap_push(heap, &heapSize, nodes, nnodes++);
     }
 
     // Write the tree breadth-first, and create the path lookup table.
-    write_tree(dest, freqs, nitems, encoding);
-
-    free(tree);
-    free(freqs);
-
-    // Encode the data itself.
-    int destPos = 4 + nitems * 2;
-    uint32_t destBuf = 0;
-    uint32_t srcBuf = 0;
-    int destBitPos = 0;
-
-    for (int srcPos = 0; srcPos < srcSize;) {
-        read_32_le(src, &srcPos, &srcBuf);
-        for (int i = 0; i < 32 / bitDepth; i++) {
-            write_bits(dest, &destPos, encoding, srcBuf & (0xFF >> (8 - bitDepth)), &destBuf, &destBitPos);
-            srcBuf >>= bitDepth;
+    write_tree(dest, &nodes[nnodes - 1], nitems, encoding);
+
+    free(heap);
+    free(nodes);
+
+    // Encode the data itself, starting with the lowest nybble of each byte.
+    int destPos = 4 + (dest[4] + 1) * 2;
+    int valueMask = nkeys - 1;
+    uint64_t destBuf = 0;
+    int destBits = 0;
+
+    for (int i = 0; i < nvalues; i++) {
+        int value = (src[i * bitDepth / 8] >> (i * bitDepth % 8)) & valueMask;
+        destBuf = (destBuf << encoding[value].nbits) | encoding[value].bitstring;
+        destBits += encoding[value].nbits;
+        if (destBits >= 32) {
+            destBits -= 32;
+            write_32_le(dest, &destPos, destBuf >> destBits);
         }
     }
 
-    if (destBitPos != 0) {
-        write_32_le(dest, &destPos, &destBuf, &destBitPos);
+    // The bitstream is read from the top bit of each word down, so the last
+    // word is padded at the bottom.
+    if (destBits != 0) {
+        write_32_le(dest, &destPos, destBuf << (32 - destBits));
     }
 
     free(encoding);
@@ -335,7 +388,7 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
     dest[1] = srcSize;
     dest[2] = srcSize >> 8;
     dest[3] = srcSize >> 16;
-    *compressedSize_p = (destPos + 3) & ~3;
+    *compressedSize_p = destPos;
     return dest;
 
 fail:
@@ -343,7 +396,7 @@ fail:
 }
 
 unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompressedSize_p) {
-    if (srcSize < 4)
+    if (srcSize < 5)
         goto fail;
 
     int bitDepth = *src & 15;
@@ -352,47 +405,73 @@ unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompres
 
     int destSize = (src[3] << 16) | (src[2] << 8) | src[1];
 
-    unsigned char *dest = malloc(destSize);
+    unsigned char *dest = calloc(destSize, 1);
 
     if (dest == NULL)
         goto fail;
 
-    int treePos = 5;
     int treeSize = (src[4] + 1) * 2;
     int srcPos = 4 + treeSize;
-    int destPos = 0;
-    int curValPos = 0;
-    uint32_t destTmp = 0;
-    uint32_t window;
-
-    for (;;)
-    {
-        if (srcPos >= srcSize)
+
+    if (srcPos > srcSize)
+        goto fail;
+
+    struct LookupEntry table[1 << LOOKUP_BITS];
+    fill_lookup_table(src, srcSize, table, 5, 0, 0);
+
+    int nvalues = destSize * 8 / bitDepth;
+    int valueMask = (1 << bitDepth) - 1;
+    uint64_t window = 0;
+    int windowBits = 0;
+
+    for (int i = 0; i < nvalues; i++) {
+        if (windowBits < 32 && srcPos + 4 <= srcSize) {
+            window = (window << 32) | read_32_le(src, &srcPos);
+            windowBits += 32;
+        }
+
+        int index;
+        if (windowBits >= LOOKUP_BITS)
+            index = window >> (windowBits - LOOKUP_BITS);
+        else
+            index = window << (LOOKUP_BITS - windowBits);
+        struct LookupEntry entry = table[index & ((1 << LOOKUP_BITS) - 1)];
+
+        if (entry.nbits > windowBits)
             goto fail;
-        read_32_le(src, &srcPos, &window);
-        for (int i = 0; i < 32; i++) {
-            int curBit = (window >> 31) & 1;
-            unsigned char treeView = src[treePos];
-            bool isLeaf = ((treeView << curBit) & 0x80) != 0;
-            treePos &= ~1; // align
-            treePos += ((treeView & 0x3F) + 1) * 2 + curBit;
-            if (isLeaf) {
-                destTmp >>= bitDepth;
-                destTmp |= (src[treePos] << (32 - bitDepth));
-                curValPos++;
-                if (curValPos == 32 / bitDepth) {
-                    write_32_le(dest, &destPos, &destTmp, &curValPos);
-                    if (destPos == destSize) {
-                        *uncompressedSize_p = destSize;
-                        return dest;
-                    }
+        windowBits -= entry.nbits;
+
+        int value = entry.value;
+        if (!entry.isLeaf) {
+            int treePos = entry.value;
+            for (;;) {
+                if (windowBits == 0) {
+                    if (srcPos + 4 > srcSize)
+                        goto fail;
+                    window = read_32_le(src, &srcPos);
+                    windowBits = 32;
+                }
+                int curBit = (window >> --windowBits) & 1;
+                unsigned char treeView = src[treePos];
+                treePos = (treePos & ~1) + ((treeView & 0x3F) + 1) * 2 + curBit;
+                if (treePos >= srcSize)
+                    goto fail;
+                if (((treeView << curBit) & 0x80) != 0) {
+                    value = src[treePos];
+                    break;
                 }
-                treePos = 5;
             }
-            window <<= 1;
         }
+
+        if (bitDepth == 8)
+            dest[i] = value;
+        else
+            dest[i / 2] |= (value & valueMask) << (i % 2 * 4);
     }
 
+    *uncompressedSize_p = destSize;
+    return dest;
+
 fail:
     FATAL_ERROR("Fatal error while decompressing Huff file.\n");
 }
@@ -0,0 +1,249 @@
+// Round-trip fuzz test and benchmark for the Huffman codec.
+//
+//   huff_test [ITERATIONS]        round-trips random 4-bit and 8-bit inputs, then
+//                                 checks that corrupted streams fail cleanly
+//   huff_test bench FILE [CHUNK]  measures throughput over FILE in CHUNK-byte pieces
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+#include "global.h"
+#include "huff.h"
+
+static unsigned long long sRandomState = 88172645463325252ULL;
+
+static unsigned random_u32(void) {
+    sRandomState ^= sRandomState << 13;
+    sRandomState ^= sRandomState >> 7;
+    sRandomState ^= sRandomState << 17;
+    return sRandomState;
+}
+
+enum {
+    INPUT_UNIFORM,
+    INPUT_FEW_VALUES,
+    INPUT_GEOMETRIC,
+    INPUT_MOSTLY_ZERO,
+    INPUT_TWO_NYBBLES,
+    INPUT_SINGLE_VALUE,
+    INPUT_KIND_COUNT,
+};
+
+static void generate_input(unsigned char * buffer, int size, int kind) {
+    int numValues = 1 + random_u32() % 255;
+    unsigned char single = random_u32();
+
+    for (int i = 0; i < size; i++) {
+        switch (kind) {
+        case INPUT_UNIFORM:
+            buffer[i] = random_u32();
+            break;
+        case INPUT_FEW_VALUES:
+            // Gives odd and even leaf counts alike.
+            buffer[i] = random_u32() % numValues;
+            break;
+        case INPUT_GEOMETRIC: {
+            // Skewed frequencies make deep trees, and wide ones in 8-bit mode.
+            unsigned bits = random_u32();
+            int value = 0;
+            while ((bits & 1) && value < 31) {
+                value++;
+                bits >>= 1;
+            }
+            buffer[i] = (random_u32() & 3) == 0 ? value * 8 + (random_u32() & 7) : value;
+            break;
+        }
+        case INPUT_MOSTLY_ZERO:
+            buffer[i] = i % 97 < 90 ? 0 : random_u32() % 3;
+            break;
+        case INPUT_TWO_NYBBLES:
+            buffer[i] = 0x11 * (random_u32() % 2);
+            break;
+        case INPUT_SINGLE_VALUE:
+            buffer[i] = single;
+            break;
+        }
+    }
+}
+
+static bool round_trip(unsigned char * input, int size, int bitDepth) {
+    int compressedSize, decompressedSize;
+    unsigned char * compressed = HuffCompress(input, size, &compressedSize, bitDepth);
+    unsigned char * decompressed = HuffDecompress(compressed, compressedSize, &decompressedSize);
+    bool ok = decompressedSize == size && memcmp(decompressed, input, size) == 0;
+
+    free(compressed);
+    free(decompressed);
+    return ok;
+}
+
+static int run_fuzz(int iterations) {
+    unsigned char * buffer = malloc(0x10000);
+    int failures = 0;
+
+    if (buffer == NULL)
+        FATAL_ERROR("Failed to allocate the test buffer.\n");
+
+    for (int i = 0; i < iterations; i++) {
+        int kind = i % INPUT_KIND_COUNT;
+        int bitDepth = (i / INPUT_KIND_COUNT) % 2 ? 8 : 4;
+        // Include sizes that aren't a multiple of 4.
+        int size = 1 + random_u32() % 0x2000;
+
+        generate_input(buffer, size, kind);
+        if (!round_trip(buffer, size, bitDepth)) {
+            fprintf(stderr, "Round trip failed: iteration %d, %d-bit, input kind %d, %d bytes\n", i, bitDepth, kind, size);
+            failures++;
+        }
+    }
+
+    // Every byte value, so the 8-bit tree has all 256 leaves.
+    for (int i = 0; i < 0x10000; i++)
+        buffer[i] = i % 256 < 128 ? i % 256 : (i * 7) % 256;
+    for (int bitDepth = 4; bitDepth <= 8; bitDepth += 4) {
+        if (!round_trip(buffer, 0x10000, bitDepth)) {
+            fprintf(stderr, "Round trip failed: all byte values, %d-bit\n", bitDepth);
+            failures++;
+        }
+    }
+
+    printf("%d of %d round trips failed.\n", failures, iterations + 2);
+    free(buffer);
+    return failures;
+}
+
+#ifndef _WIN32
+// Decodes damaged and truncated streams in a child process. Rejecting them is
+// fine; crashing is not.
+static int run_corruption(int iterations) {
+    unsigned char buffer[0x500];
+    int crashes = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        int size = 1 + random_u32() % sizeof(buffer);
+        generate_input(buffer, size, i % INPUT_KIND_COUNT);
+
+        int compressedSize;
+        unsigned char * compressed = HuffCompress(buffer, size, &compressedSize, random_u32() & 1 ? 8 : 4);
+
+        for (int flips = 1 + random_u32() % 4; flips > 0; flips--)
+            compressed[random_u32() % compressedSize] ^= 1 << (random_u32() % 8);
+        if (random_u32() % 3 == 0)
+            compressedSize = random_u32() % compressedSize;
+
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid == 0) {
+            // A rejected stream is reported through FATAL_ERROR; keep it quiet.
+            if (freopen("/dev/null", "w", stderr) == NULL)
+                _exit(1);
+            int decompressedSize;
+            free(HuffDecompress(compressed, compressedSize, &decompressedSize));
+            _exit(0);
+        }
+
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0)
+            FATAL_ERROR("Failed to run a decoding process.\n");
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "Decoding a corrupted stream crashed: iteration %d\n", i);
+            crashes++;
+        }
+
+        free(compressed);
+    }
+
+    printf("%d of %d corrupted streams crashed the decoder.\n", crashes, iterations);
+    return crashes;
+}
+#endif
+
+static double seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static int run_benchmark(const char * path, int chunkSize) {
+    FILE * fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
+
+    fseek(fp, 0, SEEK_END);
+    int fileSize = ftell(fp);
+    rewind(fp);
+
+    unsigned char * data = malloc(fileSize > 0 ? fileSize : 1);
+
+    if (data == NULL || (int)fread(data, 1, fileSize, fp) != fileSize)
+        FATAL_ERROR("Failed to read \"%s\".\n", path);
+
+    fclose(fp);
+
+    if (chunkSize <= 0 || chunkSize > fileSize)
+        chunkSize = fileSize;
+
+    for (int bitDepth = 4; bitDepth <= 8; bitDepth += 4) {
+        double compressTime = 0, decompressTime = 0;
+        long long inputBytes = 0, outputBytes = 0;
+
+        // Repeat small files so that the timings mean something.
+        for (int pass = 0; inputBytes < (1 << 24); pass++) {
+            for (int offset = 0; offset + chunkSize <= fileSize; offset += chunkSize) {
+                int compressedSize, decompressedSize;
+                double start = seconds();
+                unsigned char * compressed = HuffCompress(data + offset, chunkSize, &compressedSize, bitDepth);
+                double middle = seconds();
+                unsigned char * decompressed = HuffDecompress(compressed, compressedSize, &decompressedSize);
+                double end = seconds();
+
+                if (decompressedSize != chunkSize || memcmp(decompressed, data + offset, chunkSize) != 0)
+                    FATAL_ERROR("Round trip failed: %d-bit, offset %d\n", bitDepth, offset);
+
+                compressTime += middle - start;
+                decompressTime += end - middle;
+                inputBytes += chunkSize;
+                if (pass == 0)
+                    outputBytes += compressedSize;
+
+                free(compressed);
+                free(decompressed);
+            }
+        }
+
+        double megabytes = inputBytes / 1e6;
+        int chunksPerPass = fileSize / chunkSize;
+        printf("%d-bit, %d-byte chunks: compress %.1f MB/s, decompress %.1f MB/s, ratio %.3f\n",
+               bitDepth, chunkSize, megabytes / compressTime, megabytes / decompressTime,
+               (double)outputBytes / ((long long)chunksPerPass * chunkSize));
+    }
+
+    free(data);
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    if (argc >= 3 && strcmp(argv[1], "bench") == 0)
+        return run_benchmark(argv[2], argc >= 4 ? atoi(argv[3]) : 0);
+
+    if (argc > 2)
+        FATAL_ERROR("Usage: huff_test [ITERATIONS]\n       huff_test bench FILE [CHUNK]\n");
+
+    int iterations = argc == 2 ? atoi(argv[1]) : 2000;
+    int failures = run_fuzz(iterations);
+
+#ifndef _WIN32
+    failures += run_corruption(iterations);
+#endif
+
+    return failures != 0;
+}
@@ -69,7 +69,154 @@ fail:
 	FATAL_ERROR("Fatal error while decompressing LZ file.\n");
 }
 
-unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+// Positions are chained by a hash of the three bytes starting there, so the
+// search only visits earlier positions that can start a match of the minimum
+// length. Chains run from the nearest position to the furthest, the same
+// order as the brute-force search over every distance, so the first longest
+// match found is the one at the shortest distance, as before.
+#define LZ_HASH_BITS 14
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+#define LZ_MAX_DISTANCE 0x1000
+#define LZ_MIN_BLOCK_SIZE 3
+#define LZ_MAX_BLOCK_SIZE 18
+
+struct LZMatchFinder {
+	unsigned char *src;
+	int srcSize;
+	int minDistance;
+	int insertPos;
+	int head[LZ_HASH_SIZE];
+	int *prev;
+};
+
+static int LZHash(unsigned char *p)
+{
+	unsigned int value = (p[0] << 16) | (p[1] << 8) | p[2];
+
+	return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void LZInitMatchFinder(struct LZMatchFinder *finder, unsigned char *src, int srcSize, int minDistance)
+{
+	finder->src = src;
+	finder->srcSize = srcSize;
+	finder->minDistance = minDistance;
+	finder->insertPos = 0;
+
+	for (int i = 0; i < LZ_HASH_SIZE; i++)
+		finder->head[i] = -1;
+
+	finder->prev = malloc(srcSize * sizeof(int));
+
+	if (finder->prev == NULL)
+		FATAL_ERROR("Failed to allocate memory for LZ match finder.\n");
+}
+
+// Adds every position before pos to the hash chains.
+static void LZInsertUpTo(struct LZMatchFinder *finder, int pos)
+{
+	int lastPos = finder->srcSize - LZ_MIN_BLOCK_SIZE;
+
+	if (pos > lastPos + 1)
+		pos = lastPos + 1;
+
+	while (finder->insertPos < pos) {
+		int hash = LZHash(&finder->src[finder->insertPos]);
+
+		finder->prev[finder->insertPos] = finder->head[hash];
+		finder->head[hash] = finder->insertPos;
+		finder->insertPos++;
+	}
+}
+
+// Finds the longest match for the data at srcPos, preferring the shortest
+// distance among equally long ones. Returns the match length, which is less
+// than LZ_MIN_BLOCK_SIZE if there's no usable match.
+static int LZFindMatch(struct LZMatchFinder *finder, int srcPos, int *bestBlockDistance)
+{
+	unsigned char *src = finder->src;
+	int maxBlockSize = finder->srcSize - srcPos;
+	int bestBlockSize = 0;
+
+	if (maxBlockSize > LZ_MAX_BLOCK_SIZE)
+		maxBlockSize = LZ_MAX_BLOCK_SIZE;
+
+	if (maxBlockSize < LZ_MIN_BLOCK_SIZE || finder->minDistance > LZ_MAX_DISTANCE)
+		return 0;
+
+	LZInsertUpTo(finder, srcPos);
+
+	for (int blockStart = finder->head[LZHash(&src[srcPos])]; blockStart >= 0; blockStart = finder->prev[blockStart]) {
+		int blockDistance = srcPos - blockStart;
+
+		if (blockDistance > LZ_MAX_DISTANCE)
+			break;
+
+		if (blockDistance < finder->minDistance)
+			continue;
+
+		int blockSize = 0;
+
+		while (blockSize < maxBlockSize && src[blockStart + blockSize] == src[srcPos + blockSize])
+			blockSize++;
+
+		if (blockSize > bestBlockSize) {
+			*bestBlockDistance = blockDistance;
+			bestBlockSize = blockSize;
+
+			if (blockSize == maxBlockSize)
+				break;
+		}
+	}
+
+	return bestBlockSize;
+}
+
+// Chooses the block to emit at each position so that the output is as small
+// as possible, instead of always taking the longest match. A literal costs 9
+// bits (a byte and its flag bit) and a block 17, and any prefix of at least
+// LZ_MIN_BLOCK_SIZE bytes of the longest match at a position is also a valid
+// block, so the cheapest way to encode each suffix of the data follows from
+// the suffixes after it. On return, blockSizes[pos] and blockDistances[pos]
+// hold the block to emit at each position the parse visits; a size below
+// LZ_MIN_BLOCK_SIZE means a literal.
+static void LZOptimalParse(unsigned char *src, int srcSize, const int minDistance, int *blockSizes, int *blockDistances)
+{
+	struct LZMatchFinder finder;
+	int *cost = malloc((srcSize + 1) * sizeof(int));
+
+	if (cost == NULL)
+		FATAL_ERROR("Failed to allocate memory for LZ optimal parse.\n");
+
+	LZInitMatchFinder(&finder, src, srcSize, minDistance);
+
+	for (int pos = 0; pos < srcSize; pos++)
+		blockSizes[pos] = LZFindMatch(&finder, pos, &blockDistances[pos]);
+
+	free(finder.prev);
+
+	cost[srcSize] = 0;
+
+	for (int pos = srcSize - 1; pos >= 0; pos--) {
+		int longestBlockSize = blockSizes[pos];
+		int bestBlockSize = 1;
+
+		cost[pos] = 9 + cost[pos + 1];
+
+		for (int blockSize = LZ_MIN_BLOCK_SIZE; blockSize <= longestBlockSize; blockSize++) {
+			if (17 + cost[pos + blockSize] <= cost[pos]) {
+				cost[pos] = 17 + cost[pos + blockSize];
+				bestBlockSize = blockSize;
+			}
+		}
+
+		blockSizes[pos] = bestBlockSize;
+	}
+
+	free(cost);
+}
+
+unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance, const bool optimal)
 {
 	if (srcSize <= 0)
 		goto fail;
@@ -90,6 +237,22 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 	dest[2] = (unsigned char)(srcSize >> 8);
 	dest[3] = (unsigned char)(srcSize >> 16);
 
+	struct LZMatchFinder finder;
+	int *blockSizes = NULL;
+	int *blockDistances = NULL;
+
+	if (optimal) {
+		blockSizes = malloc(srcSize * sizeof(int));
+		blockDistances = malloc(srcSize * sizeof(int));
+
+		if (blockSizes == NULL || blockDistances == NULL)
+			goto fail;
+
+		LZOptimalParse(src, srcSize, minDistance, blockSizes, blockDistances);
+	} else {
+		LZInitMatchFinder(&finder, src, srcSize, minDistance);
+	}
+
 	int srcPos = 0;
 	int destPos = 4;
 
@@ -99,30 +262,16 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 
 		for (int i = 0; i < 8; i++) {
 			int bestBlockDistance = 0;
-			int bestBlockSize = 0;
-			int blockDistance = minDistance;
-
-			while (blockDistance <= srcPos && blockDistance <= 0x1000) {
-				int blockStart = srcPos - blockDistance;
-				int blockSize = 0;
+			int bestBlockSize;
 
-				while (blockSize < 18
-				    && srcPos + blockSize < srcSize
-				    && src[blockStart + blockSize] == src[srcPos + blockSize])
-					blockSize++;
-
-				if (blockSize > bestBlockSize) {
-					bestBlockDistance = blockDistance;
-					bestBlockSize = blockSize;
-
-					if (blockSize == 18)
-						break;
-				}
-
-				blockDistance++;
+			if (optimal) {
+				bestBlockSize = blockSizes[srcPos];
+				bestBlockDistance = blockDistances[srcPos];
+			} else {
+				bestBlockSize = LZFindMatch(&finder, srcPos, &bestBlockDistance);
 			}
 
-			if (bestBlockSize >= 3) {
+			if (bestBlockSize >= LZ_MIN_BLOCK_SIZE) {
 				*flags |= (0x80 >> i);
 				srcPos += bestBlockSize;
 				bestBlockSize -= 3;
@@ -142,6 +291,13 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 						dest[destPos++] = 0;
 				}
 
+				if (optimal) {
+					free(blockSizes);
+					free(blockDistances);
+				} else {
+					free(finder.prev);
+				}
+
 				*compressedSize = destPos;
 				return dest;
 			}
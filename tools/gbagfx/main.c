@@ -13,6 +13,9 @@
 #include "rl.h"
 #include "font.h"
 #include "huff.h"
+#include "batch.h"
+#include "cache.h"
+#include "palpack.h"
 
 struct CommandHandler
 {
@@ -74,21 +77,77 @@ void ConvertGbaToPng(char *inputPath, char *outputPath, struct GbaToPngOptions *
     FreeImage(&image);
 }
 
-void ConvertPngToGba(char *inputPath, char *outputPath, struct PngToGbaOptions *options)
+unsigned char *ConvertPngToGbaData(char *inputPath, struct PngToGbaOptions *options, int *size)
 {
     struct Image image;
+    unsigned char *buffer;
+
+    if (options->tilemapFilePath != NULL && !options->isTiled)
+        FATAL_ERROR("\"-tilemap\" can't be used with \"-plain\".\n");
+    if (options->isAffineMap && (options->tilemapFilePath == NULL || options->bitDepth != 8))
+        FATAL_ERROR("\"-affine\" needs \"-tilemap\" and an 8bpp output.\n");
+    // A tilemap lays tiles out in screen order, which metatiles would scramble.
+    if (options->tilemapFilePath != NULL && (options->metatileWidth != 1 || options->metatileHeight != 1))
+        FATAL_ERROR("\"-tilemap\" can't be used with \"-mwidth\" or \"-mheight\".\n");
 
     image.bitDepth = options->bitDepth;
     image.tilemap.data.affine = NULL; // initialize to NULL to avoid issues in FreeImage
 
     ReadPng(inputPath, &image);
 
-    if (options->isTiled)
-        WriteTileImage(outputPath, options->numTilesMode, options->numTiles, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette);
+    if (options->tilemapFilePath != NULL)
+    {
+        // The map covers the whole image; "-num_tiles" then sets how many
+        // tiles the deduplicated tile data is padded to.
+        int tileSize = image.bitDepth * 8;
+        buffer = ConvertToTileImage(NUM_TILES_IGNORE, 0, 1, 1, &image, !image.hasPalette, size);
+
+        int numTiles = *size / tileSize;
+        int tilemapSize;
+        unsigned char *tilemap = BuildTilemap(buffer, &numTiles, image.bitDepth, options->isAffineMap, &tilemapSize);
+
+        WriteWholeFile(options->tilemapFilePath, tilemap, tilemapSize);
+        free(tilemap);
+
+        if (options->numTiles > numTiles)
+        {
+            buffer = realloc(buffer, options->numTiles * tileSize);
+
+            if (buffer == NULL)
+                FATAL_ERROR("Failed to allocate memory for pixels.\n");
+
+            memset(&buffer[numTiles * tileSize], 0, (options->numTiles - numTiles) * tileSize);
+            numTiles = options->numTiles;
+        }
+        else if (options->numTiles != 0 && options->numTiles < numTiles)
+        {
+            FATAL_ERROR("The image has %d unique tiles, more than the specified number of tiles (%d).\n", numTiles, options->numTiles);
+        }
+
+        *size = numTiles * tileSize;
+    }
+    else if (options->isTiled)
+    {
+        buffer = ConvertToTileImage(options->numTilesMode, options->numTiles, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette, size);
+    }
     else
-        WritePlainImage(outputPath, options->dataWidth, &image, !image.hasPalette);
+    {
+        buffer = ConvertToPlainImage(options->dataWidth, &image, !image.hasPalette, size);
+    }
 
     FreeImage(&image);
+
+    return buffer;
+}
+
+void ConvertPngToGba(char *inputPath, char *outputPath, struct PngToGbaOptions *options)
+{
+    int size;
+    unsigned char *buffer = ConvertPngToGbaData(inputPath, options, &size);
+
+    WriteWholeFile(outputPath, buffer, size);
+
+    free(buffer);
 }
 
 void HandleGbaToPngCommand(char *inputPath, char *outputPath, int argc, char **argv)
@@ -201,89 +260,116 @@ void HandleGbaToPngCommand(char *inputPath, char *outputPath, int argc, char **a
     ConvertGbaToPng(inputPath, outputPath, &options);
 }
 
-void HandlePngToGbaCommand(char *inputPath, char *outputPath, int argc, char **argv)
+// Parses the option at argv[*i] if it's one of the PNG to GBA conversion
+// options, advancing *i past its value.
+static bool ParsePngToGbaOption(int argc, char **argv, int *i, struct PngToGbaOptions *options)
 {
-    char *outputFileExtension = GetFileExtensionAfterDot(outputPath);
-    struct PngToGbaOptions options;
-    options.numTilesMode = NUM_TILES_IGNORE;
-    options.numTiles = 0;
-    options.bitDepth = outputFileExtension[0] - '0';
-    options.metatileWidth = 1;
-    options.metatileHeight = 1;
-    options.tilemapFilePath = NULL;
-    options.isAffineMap = false;
-    options.isTiled = true;
-    options.dataWidth = 1;
+    char *option = argv[*i];
 
-    for (int i = 3; i < argc; i++)
+    if (strcmp(option, "-num_tiles") == 0)
     {
-        char *option = argv[i];
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No number of tiles following \"-num_tiles\".\n");
 
-        if (strcmp(option, "-num_tiles") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No number of tiles following \"-num_tiles\".\n");
+        (*i)++;
 
-            i++;
+        if (!ParseNumber(argv[*i], NULL, 10, &options->numTiles))
+            FATAL_ERROR("Failed to parse number of tiles.\n");
 
-            if (!ParseNumber(argv[i], NULL, 10, &options.numTiles))
-                FATAL_ERROR("Failed to parse number of tiles.\n");
+        if (options->numTiles < 1)
+            FATAL_ERROR("Number of tiles must be positive.\n");
+    }
+    else if (strcmp(option, "-Wnum_tiles") == 0) {
+        options->numTilesMode = NUM_TILES_WARN;
+    }
+    else if (strcmp(option, "-Werror=num_tiles") == 0) {
+        options->numTilesMode = NUM_TILES_ERROR;
+    }
+    else if (strcmp(option, "-mwidth") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No metatile width value following \"-mwidth\".\n");
 
-            if (options.numTiles < 1)
-                FATAL_ERROR("Number of tiles must be positive.\n");
-        }
-        else if (strcmp(option, "-Wnum_tiles") == 0) {
-            options.numTilesMode = NUM_TILES_WARN;
-        }
-        else if (strcmp(option, "-Werror=num_tiles") == 0) {
-            options.numTilesMode = NUM_TILES_ERROR;
-        }
-        else if (strcmp(option, "-mwidth") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No metatile width value following \"-mwidth\".\n");
+        (*i)++;
 
-            i++;
+        if (!ParseNumber(argv[*i], NULL, 10, &options->metatileWidth))
+            FATAL_ERROR("Failed to parse metatile width.\n");
 
-            if (!ParseNumber(argv[i], NULL, 10, &options.metatileWidth))
-                FATAL_ERROR("Failed to parse metatile width.\n");
+        if (options->metatileWidth < 1)
+            FATAL_ERROR("metatile width must be positive.\n");
+    }
+    else if (strcmp(option, "-mheight") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No metatile height value following \"-mheight\".\n");
 
-            if (options.metatileWidth < 1)
-                FATAL_ERROR("metatile width must be positive.\n");
-        }
-        else if (strcmp(option, "-mheight") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No metatile height value following \"-mheight\".\n");
+        (*i)++;
 
-            i++;
+        if (!ParseNumber(argv[*i], NULL, 10, &options->metatileHeight))
+            FATAL_ERROR("Failed to parse metatile height.\n");
 
-            if (!ParseNumber(argv[i], NULL, 10, &options.metatileHeight))
-                FATAL_ERROR("Failed to parse metatile height.\n");
+        if (options->metatileHeight < 1)
+            FATAL_ERROR("metatile height must be positive.\n");
+    }
+    else if (strcmp(option, "-tilemap") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No tilemap value following \"-tilemap\".\n");
+        (*i)++;
+        options->tilemapFilePath = argv[*i];
+    }
+    else if (strcmp(option, "-affine") == 0)
+    {
+        options->isAffineMap = true;
+    }
+    else if (strcmp(option, "-plain") == 0)
+    {
+        options->isTiled = false;
+    }
+    else if (strcmp(option, "-data_width") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No data width value following \"-data_width\".\n");
+        (*i)++;
 
-            if (options.metatileHeight < 1)
-                FATAL_ERROR("metatile height must be positive.\n");
-        }
-        else if (strcmp(option, "-plain") == 0)
-        {
-            options.isTiled = false;
-        }
-        else if (strcmp(option, "-data_width") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No data width value following \"-data_width\".\n");
-            i++;
+        if (!ParseNumber(argv[*i], NULL, 10, &options->dataWidth))
+            FATAL_ERROR("Failed to parse data width.\n");
 
-            if (!ParseNumber(argv[i], NULL, 10, &options.dataWidth))
-                FATAL_ERROR("Failed to parse data width.\n");
+        if (options->dataWidth < 1)
+            FATAL_ERROR("Data width must be positive.\n");
+    }
+    else
+    {
+        return false;
+    }
 
-            if (options.dataWidth < 1)
-                FATAL_ERROR("Data width must be positive.\n");
-        }
-        else
-        {
-            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
-        }
+    return true;
+}
+
+static void InitPngToGbaOptions(struct PngToGbaOptions *options, int bitDepth)
+{
+    options->numTilesMode = NUM_TILES_IGNORE;
+    options->numTiles = 0;
+    options->bitDepth = bitDepth;
+    options->metatileWidth = 1;
+    options->metatileHeight = 1;
+    options->tilemapFilePath = NULL;
+    options->isAffineMap = false;
+    options->isTiled = true;
+    options->dataWidth = 1;
+}
+
+void HandlePngToGbaCommand(char *inputPath, char *outputPath, int argc, char **argv)
+{
+    char *outputFileExtension = GetFileExtensionAfterDot(outputPath);
+    struct PngToGbaOptions options;
+
+    InitPngToGbaOptions(&options, outputFileExtension[0] - '0');
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (!ParsePngToGbaOption(argc, argv, &i, &options))
+            FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
     }
 
     ConvertPngToGba(inputPath, outputPath, &options);
@@ -422,62 +508,91 @@ void HandlePngToFullwidthJapaneseFontCommand(char *inputPath, char *outputPath,
     FreeImage(&image);
 }
 
-void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char **argv)
+static void InitLZOptions(struct LZOptions *options)
 {
-    int overflowSize = 0;
-    int minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    options->overflowSize = 0;
+    options->minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    options->optimal = false;
+}
 
-    for (int i = 3; i < argc; i++)
+static bool ParseLZOption(int argc, char **argv, int *i, struct LZOptions *options)
+{
+    char *option = argv[*i];
+
+    if (strcmp(option, "-overflow") == 0)
     {
-        char *option = argv[i];
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No size following \"-overflow\".\n");
 
-        if (strcmp(option, "-overflow") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No size following \"-overflow\".\n");
+        (*i)++;
 
-            i++;
+        if (!ParseNumber(argv[*i], NULL, 10, &options->overflowSize))
+            FATAL_ERROR("Failed to parse overflow size.\n");
 
-            if (!ParseNumber(argv[i], NULL, 10, &overflowSize))
-                FATAL_ERROR("Failed to parse overflow size.\n");
-
-            if (overflowSize < 1)
-                FATAL_ERROR("Overflow size must be positive.\n");
-        }
-        else if (strcmp(option, "-search") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No size following \"-search\".\n");
+        if (options->overflowSize < 1)
+            FATAL_ERROR("Overflow size must be positive.\n");
+    }
+    else if (strcmp(option, "-search") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No size following \"-search\".\n");
 
-            i++;
+        (*i)++;
 
-            if (!ParseNumber(argv[i], NULL, 10, &minDistance))
-                FATAL_ERROR("Failed to parse LZ min search distance.\n");
+        if (!ParseNumber(argv[*i], NULL, 10, &options->minDistance))
+            FATAL_ERROR("Failed to parse LZ min search distance.\n");
 
-            if (minDistance < 1)
-                FATAL_ERROR("LZ min search distance must be positive.\n");
-        }
-        else
-        {
-            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
-        }
+        if (options->minDistance < 1)
+            FATAL_ERROR("LZ min search distance must be positive.\n");
+    }
+    else if (strcmp(option, "-optimal") == 0)
+    {
+        options->optimal = true;
     }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
 
+// Compresses size bytes of buffer, which must be followed by
+// options->overflowSize zero bytes.
+static unsigned char *CompressLZ(unsigned char *buffer, int size, struct LZOptions *options, int *compressedSize)
+{
     // The overflow option allows a quirk in some of Ruby/Sapphire's tilesets
     // to be reproduced. It works by appending a number of zeros to the data
     // before compressing it and then amending the LZ header's size field to
     // reflect the expected size. This will cause an overflow when decompressing
     // the data.
 
+    unsigned char *compressedData = LZCompress(buffer, size + options->overflowSize, compressedSize, options->minDistance, options->optimal);
+
+    compressedData[1] = (unsigned char)size;
+    compressedData[2] = (unsigned char)(size >> 8);
+    compressedData[3] = (unsigned char)(size >> 16);
+
+    return compressedData;
+}
+
+void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char **argv)
+{
+    struct LZOptions options;
+
+    InitLZOptions(&options);
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (!ParseLZOption(argc, argv, &i, &options))
+            FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
+    }
+
     int fileSize;
-    unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, overflowSize);
+    unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, options.overflowSize);
 
     int compressedSize;
-    unsigned char *compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
-
-    compressedData[1] = (unsigned char)fileSize;
-    compressedData[2] = (unsigned char)(fileSize >> 8);
-    compressedData[3] = (unsigned char)(fileSize >> 16);
+    unsigned char *compressedData = CompressLZ(buffer, fileSize, &options, &compressedSize);
 
     free(buffer);
 
@@ -531,32 +646,40 @@ void HandleRLDecompressCommand(char *inputPath, char *outputPath, int argc UNUSE
     free(uncompressedData);
 }
 
-void HandleHuffCompressCommand(char *inputPath, char *outputPath, int argc, char **argv)
+static bool ParseHuffOption(int argc, char **argv, int *i, int *bitDepth)
 {
-    int fileSize;
-    int bitDepth = 4;
+    char *option = argv[*i];
 
-    for (int i = 3; i < argc; i++)
+    if (strcmp(option, "-depth") == 0)
     {
-        char *option = argv[i];
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No size following \"-depth\".\n");
 
-        if (strcmp(option, "-depth") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No size following \"-depth\".\n");
+        (*i)++;
 
-            i++;
+        if (!ParseNumber(argv[*i], NULL, 10, bitDepth))
+            FATAL_ERROR("Failed to parse bit depth.\n");
 
-            if (!ParseNumber(argv[i], NULL, 10, &bitDepth))
-                FATAL_ERROR("Failed to parse bit depth.\n");
+        if (*bitDepth != 4 && *bitDepth != 8)
+            FATAL_ERROR("GBA only supports bit depth of 4 or 8.\n");
+    }
+    else
+    {
+        return false;
+    }
 
-            if (bitDepth != 4 && bitDepth != 8)
-                FATAL_ERROR("GBA only supports bit depth of 4 or 8.\n");
-        }
-        else
-        {
-            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
-        }
+    return true;
+}
+
+void HandleHuffCompressCommand(char *inputPath, char *outputPath, int argc, char **argv)
+{
+    int fileSize;
+    int bitDepth = 4;
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (!ParseHuffOption(argc, argv, &i, &bitDepth))
+            FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
     }
 
     unsigned char *buffer = ReadWholeFile(inputPath, &fileSize);
@@ -586,12 +709,115 @@ void HandleHuffDecompressCommand(char *inputPath, char *outputPath, int argc UNU
     free(uncompressedData);
 }
 
-int main(int argc, char **argv)
+// Converts a PNG and compresses the result in one step, without going through
+// an intermediate file: "gbagfx foo.png foo.4bpp.lz" does the work of
+// "gbagfx foo.png foo.4bpp" followed by "gbagfx foo.4bpp foo.4bpp.lz". The
+// format to convert to is the extension before the compression one, and the
+// options of both steps can be given. With -keep_intermediate, the
+// uncompressed data is written out as well, to the output path without the
+// compression extension. Outputs that don't name a GBA format are compressed
+// from the PNG file as it is, as before.
+void HandlePngToCompressedGbaCommand(char *inputPath, char *outputPath, int argc, char **argv)
 {
-    char converted = 0;
+    char *compressionExtension = GetFileExtensionAfterDot(outputPath);
+    int intermediatePathLength = compressionExtension - 1 - outputPath;
+    char *intermediatePath = malloc(intermediatePathLength + 1);
 
-    if (argc < 3)
-        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n");
+    if (intermediatePath == NULL)
+        FATAL_ERROR("Failed to allocate memory for intermediate path.\n");
+
+    memcpy(intermediatePath, outputPath, intermediatePathLength);
+    intermediatePath[intermediatePathLength] = 0;
+
+    char *formatExtension = GetFileExtensionAfterDot(intermediatePath);
+    bool isPalette = formatExtension != NULL && strcmp(formatExtension, "gbapal") == 0;
+    bool isImage = formatExtension != NULL
+                && (strcmp(formatExtension, "1bpp") == 0 || strcmp(formatExtension, "4bpp") == 0 || strcmp(formatExtension, "8bpp") == 0);
+
+    if (!isPalette && !isImage)
+    {
+        free(intermediatePath);
+
+        if (strcmp(compressionExtension, "lz") == 0)
+            HandleLZCompressCommand(inputPath, outputPath, argc, argv);
+        else if (strcmp(compressionExtension, "rl") == 0)
+            HandleRLCompressCommand(inputPath, outputPath, argc, argv);
+        else
+            HandleHuffCompressCommand(inputPath, outputPath, argc, argv);
+        return;
+    }
+
+    struct PngToGbaOptions options;
+    struct LZOptions lzOptions;
+    int huffBitDepth = 4;
+    bool keepIntermediate = false;
+    bool isLZ = strcmp(compressionExtension, "lz") == 0;
+    bool isHuff = strcmp(compressionExtension, "huff") == 0;
+
+    InitPngToGbaOptions(&options, isImage ? formatExtension[0] - '0' : 0);
+    InitLZOptions(&lzOptions);
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-keep_intermediate") == 0)
+            keepIntermediate = true;
+        else if (!(isImage && ParsePngToGbaOption(argc, argv, &i, &options))
+              && !(isLZ && ParseLZOption(argc, argv, &i, &lzOptions))
+              && !(isHuff && ParseHuffOption(argc, argv, &i, &huffBitDepth)))
+            FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
+    }
+
+    int size;
+    unsigned char *buffer;
+
+    if (isImage)
+    {
+        buffer = ConvertPngToGbaData(inputPath, &options, &size);
+    }
+    else
+    {
+        struct Palette palette = {};
+
+        ReadPngPalette(inputPath, &palette);
+        buffer = ConvertToGbaPalette(&palette, &size);
+    }
+
+    if (keepIntermediate)
+        WriteWholeFile(intermediatePath, buffer, size);
+
+    int compressedSize;
+    unsigned char *compressedData;
+
+    if (isLZ)
+    {
+        buffer = realloc(buffer, size + lzOptions.overflowSize);
+
+        if (buffer == NULL)
+            FATAL_ERROR("Failed to allocate memory for LZ overflow.\n");
+
+        memset(buffer + size, 0, lzOptions.overflowSize);
+        compressedData = CompressLZ(buffer, size, &lzOptions, &compressedSize);
+    }
+    else if (isHuff)
+    {
+        compressedData = HuffCompress(buffer, size, &compressedSize, huffBitDepth);
+    }
+    else
+    {
+        compressedData = RLCompress(buffer, size, &compressedSize);
+    }
+
+    free(buffer);
+
+    WriteWholeFile(outputPath, compressedData, compressedSize);
+
+    free(compressedData);
+    free(intermediatePath);
+}
+
+static void RunCommand(int argc, char **argv)
+{
+    char converted = 0;
 
     struct CommandHandler handlers[] =
     {
@@ -611,6 +837,9 @@ int main(int argc, char **argv)
         { "png", "hwjpnfont", HandlePngToHalfwidthJapaneseFontCommand },
         { "fwjpnfont", "png", HandleFullwidthJapaneseFontToPngCommand },
         { "png", "fwjpnfont", HandlePngToFullwidthJapaneseFontCommand },
+        { "png", "huff", HandlePngToCompressedGbaCommand },
+        { "png", "lz", HandlePngToCompressedGbaCommand },
+        { "png", "rl", HandlePngToCompressedGbaCommand },
         { NULL, "huff", HandleHuffCompressCommand },
         { NULL, "lz", HandleLZCompressCommand },
         { "huff", NULL, HandleHuffDecompressCommand },
@@ -661,7 +890,14 @@ int main(int argc, char **argv)
         if ((handlers[i].inputFileExtension == NULL || strcmp(handlers[i].inputFileExtension, inputFileExtension) == 0)
             && (handlers[i].outputFileExtension == NULL || strcmp(handlers[i].outputFileExtension, outputFileExtension) == 0))
         {
-            handlers[i].function(inputPath, outputPath, argc, argv);
+            struct CacheEntry cacheEntry;
+
+            if (!RestoreCachedOutput(inputPath, outputPath, argc, argv, &cacheEntry))
+            {
+                handlers[i].function(inputPath, outputPath, argc, argv);
+                StoreCachedOutput(&cacheEntry, outputPath);
+            }
+
             converted = 1;
             break;
         }
@@ -672,6 +908,118 @@ int main(int argc, char **argv)
 
     if (!converted)
         FATAL_ERROR("Don't know how to convert \"%s\" to \"%s\".\n", argv[1], argv[2]);
+}
+
+void HandleBatchCommand(int argc, char **argv)
+{
+    char *manifestPath = argv[2];
+    int jobCount = GetProcessorCount();
+
+    for (int i = 3; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-j") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No job count following \"-j\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &jobCount))
+                FATAL_ERROR("Failed to parse job count.\n");
+
+            if (jobCount < 1)
+                FATAL_ERROR("Job count must be positive.\n");
+        }
+        else
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+    }
+
+    RunBatch(manifestPath, jobCount, RunCommand);
+}
+
+void HandleCacheCommand(int argc, char **argv)
+{
+    char *cacheDir = argv[2];
+    bool reset = false;
+
+    for (int i = 3; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-reset") == 0)
+            reset = true;
+        else
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+    }
+
+    PrintCacheStats(cacheDir, reset);
+}
+
+void HandlePalpackCommand(int argc, char **argv)
+{
+    char *palettePath = argv[2];
+    int maxBanks = MAX_PALETTE_BANKS;
+    char **imagePaths = malloc(argc * sizeof(char *));
+    int numPaths = 0;
+
+    if (imagePaths == NULL)
+        FATAL_ERROR("Failed to allocate memory for image paths.\n");
+
+    for (int i = 3; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-banks") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No bank count following \"-banks\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &maxBanks))
+                FATAL_ERROR("Failed to parse bank count.\n");
+
+            if (maxBanks < 1 || maxBanks > MAX_PALETTE_BANKS)
+                FATAL_ERROR("Bank count must be between 1 and %d.\n", MAX_PALETTE_BANKS);
+        }
+        else if (option[0] == '-')
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+        else
+        {
+            imagePaths[numPaths++] = option;
+        }
+    }
+
+    if (numPaths == 0 || numPaths % 2 != 0)
+        FATAL_ERROR("Each input image needs an output path.\n");
+
+    PackPalettes(palettePath, imagePaths, numPaths / 2, maxBanks);
+
+    free(imagePaths);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n"
+                    "       gbagfx batch MANIFEST_PATH [-j JOBS]\n"
+                    "       gbagfx cache CACHE_DIR [-reset]\n"
+                    "       gbagfx palpack PALETTE_PATH INPUT_PATH OUTPUT_PATH... [-banks N]\n");
+
+    if (strcmp(argv[1], "batch") == 0)
+        HandleBatchCommand(argc, argv);
+    else if (strcmp(argv[1], "cache") == 0)
+        HandleCacheCommand(argc, argv);
+    else if (strcmp(argv[1], "palpack") == 0)
+        HandlePalpackCommand(argc, argv);
+    else
+        RunCommand(argc, argv);
 
     return 0;
 }
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "global.h"
+#include "gfx.h"
+#include "convert_png.h"
+#include "jasc_pal.h"
+#include "util.h"
+#include "palpack.h"
+
+#define BANK_SIZE 16
+
+struct PackedImage
+{
+    char *inputPath;
+    char *outputPath;
+    struct Image image;
+    // The opaque colors used by the image, and which of them each pixel value
+    // has. Pixel value 0 is transparent and isn't listed.
+    uint16_t colors[BANK_SIZE - 1];
+    struct Color rgb[BANK_SIZE - 1];
+    int numColors;
+    int colorIndex[256];
+    int bank;
+};
+
+struct Bank
+{
+    uint16_t colors[BANK_SIZE];
+    struct Color rgb[BANK_SIZE];
+    int numColors;
+};
+
+// Colors that only differ below the 5 bits per channel of the GBA are the
+// same color on hardware.
+static uint16_t ToGbaColor(struct Color color)
+{
+    return ((color.blue / 8) << 10) | ((color.green / 8) << 5) | (color.red / 8);
+}
+
+static void ReadPackedImage(struct PackedImage *packed)
+{
+    struct Image *image = &packed->image;
+    bool used[256] = { false };
+
+    image->bitDepth = 8;
+    image->tilemap.data.affine = NULL;
+    ReadPng(packed->inputPath, image);
+
+    if (!image->hasPalette)
+        FATAL_ERROR("\"%s\" is not an indexed image.\n", packed->inputPath);
+
+    ReadPngPalette(packed->inputPath, &image->palette);
+
+    for (int i = 0; i < image->width * image->height; i++)
+        used[image->pixels[i]] = true;
+
+    packed->numColors = 0;
+
+    for (int value = 0; value < 256; value++)
+    {
+        packed->colorIndex[value] = -1;
+
+        if (!used[value] || value == 0)
+            continue;
+
+        if (value >= image->palette.numColors)
+            FATAL_ERROR("\"%s\" uses color %d, which isn't in its palette.\n", packed->inputPath, value);
+
+        uint16_t color = ToGbaColor(image->palette.colors[value]);
+        int i = 0;
+
+        while (i < packed->numColors && packed->colors[i] != color)
+            i++;
+
+        if (i == packed->numColors)
+        {
+            if (i == BANK_SIZE - 1)
+                FATAL_ERROR("\"%s\" uses more than %d opaque colors.\n", packed->inputPath, BANK_SIZE - 1);
+
+            packed->colors[i] = color;
+            packed->rgb[i] = image->palette.colors[value];
+            packed->numColors++;
+        }
+
+        packed->colorIndex[value] = i;
+    }
+}
+
+static int FindBankColor(struct Bank *bank, uint16_t color)
+{
+    for (int i = 1; i < bank->numColors; i++)
+    {
+        if (bank->colors[i] == color)
+            return i;
+    }
+
+    return -1;
+}
+
+// Returns how many of the image's colors the bank would have to add, or -1 if
+// they don't fit.
+static int CountMissingColors(struct Bank *bank, struct PackedImage *packed)
+{
+    int missing = 0;
+
+    for (int i = 0; i < packed->numColors; i++)
+    {
+        if (FindBankColor(bank, packed->colors[i]) < 0)
+            missing++;
+    }
+
+    return bank->numColors + missing <= BANK_SIZE ? missing : -1;
+}
+
+static void AddColors(struct Bank *bank, struct PackedImage *packed)
+{
+    for (int i = 0; i < packed->numColors; i++)
+    {
+        if (FindBankColor(bank, packed->colors[i]) < 0)
+        {
+            bank->colors[bank->numColors] = packed->colors[i];
+            bank->rgb[bank->numColors] = packed->rgb[i];
+            bank->numColors++;
+        }
+    }
+}
+
+// Most colors first, keeping the input order otherwise.
+static int CompareColorCounts(const void *a, const void *b)
+{
+    const struct PackedImage *imageA = *(const struct PackedImage **)a;
+    const struct PackedImage *imageB = *(const struct PackedImage **)b;
+
+    if (imageA->numColors != imageB->numColors)
+        return imageB->numColors - imageA->numColors;
+
+    return (imageA > imageB) - (imageA < imageB);
+}
+
+static void WritePackedImage(struct PackedImage *packed, struct Bank *bank)
+{
+    struct Image *image = &packed->image;
+    unsigned char bankIndex[256];
+
+    for (int value = 0; value < 256; value++)
+    {
+        int i = packed->colorIndex[value];
+
+        bankIndex[value] = i < 0 ? 0 : FindBankColor(bank, packed->colors[i]);
+    }
+
+    int rowSize = (image->width + 1) / 2;
+    unsigned char *pixels = calloc(rowSize * image->height, 1);
+
+    if (pixels == NULL)
+        FATAL_ERROR("Failed to allocate pixel buffer.\n");
+
+    for (int y = 0; y < image->height; y++)
+    {
+        unsigned char *src = &image->pixels[y * image->width];
+        unsigned char *dest = &pixels[y * rowSize];
+
+        for (int x = 0; x < image->width; x++)
+            dest[x / 2] |= bankIndex[src[x]] << (x % 2 == 0 ? 4 : 0);
+    }
+
+    free(image->pixels);
+    image->pixels = pixels;
+    image->bitDepth = 4;
+    image->hasTransparency = false;
+    image->palette.numColors = BANK_SIZE;
+    memcpy(image->palette.colors, bank->rgb, sizeof(bank->rgb));
+
+    WritePng(packed->outputPath, image);
+    FreeImage(image);
+}
+
+static void WritePaletteTable(char *path, struct Bank *banks, int numBanks)
+{
+    char *extension = GetFileExtensionAfterDot(path);
+    struct Palette palette;
+
+    palette.numColors = numBanks * BANK_SIZE;
+
+    for (int i = 0; i < numBanks; i++)
+        memcpy(&palette.colors[i * BANK_SIZE], banks[i].rgb, sizeof(banks[i].rgb));
+
+    if (strcmp(extension, "gbapal") == 0)
+        WriteGbaPalette(path, &palette);
+    else
+        WriteJascPalette(path, &palette);
+}
+
+void PackPalettes(char *palettePath, char **imagePaths, int numImages, int maxBanks)
+{
+    char *extension = GetFileExtensionAfterDot(palettePath);
+
+    if (extension == NULL || (strcmp(extension, "gbapal") != 0 && strcmp(extension, "pal") != 0))
+        FATAL_ERROR("The palette table \"%s\" must be a .gbapal or .pal file.\n", palettePath);
+
+    struct PackedImage *images = malloc(numImages * sizeof(struct PackedImage));
+    struct PackedImage **order = malloc(numImages * sizeof(struct PackedImage *));
+    // Every image fits in a bank of its own, so there are never more banks than images.
+    struct Bank *banks = calloc(numImages, sizeof(struct Bank));
+    int numBanks = 0;
+
+    if (images == NULL || order == NULL || banks == NULL)
+        FATAL_ERROR("Failed to allocate memory for palette packing.\n");
+
+    for (int i = 0; i < numImages; i++)
+    {
+        images[i].inputPath = imagePaths[i * 2];
+        images[i].outputPath = imagePaths[i * 2 + 1];
+        ReadPackedImage(&images[i]);
+        order[i] = &images[i];
+    }
+
+    qsort(order, numImages, sizeof(struct PackedImage *), CompareColorCounts);
+
+    // Each image goes into the bank that already has the most of its colors,
+    // or into a new bank if none has room for them.
+    for (int i = 0; i < numImages; i++)
+    {
+        struct PackedImage *packed = order[i];
+        int bestBank = -1;
+        int bestMissing = BANK_SIZE;
+
+        for (int j = 0; j < numBanks; j++)
+        {
+            int missing = CountMissingColors(&banks[j], packed);
+
+            if (missing >= 0 && missing < bestMissing)
+            {
+                bestBank = j;
+                bestMissing = missing;
+            }
+        }
+
+        if (bestBank < 0)
+        {
+            struct Bank *bank = &banks[numBanks];
+
+            bank->colors[0] = ToGbaColor(packed->image.palette.colors[0]);
+            bank->rgb[0] = packed->image.palette.colors[0];
+            bank->numColors = 1;
+            bestBank = numBanks++;
+        }
+
+        AddColors(&banks[bestBank], packed);
+        packed->bank = bestBank;
+    }
+
+    if (numBanks > maxBanks)
+        FATAL_ERROR("The palettes need %d banks, but only %d are available.\n", numBanks, maxBanks);
+
+    for (int i = 0; i < numImages; i++)
+    {
+        WritePackedImage(&images[i], &banks[images[i].bank]);
+        printf("%s: bank %d\n", images[i].inputPath, images[i].bank);
+    }
+
+    WritePaletteTable(palettePath, banks, numBanks);
+    printf("%d palettes packed into %d banks.\n", numImages, numBanks);
+
+    free(banks);
+    free(order);
+    free(images);
+}
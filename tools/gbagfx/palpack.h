@@ -0,0 +1,16 @@
+#ifndef PALPACK_H
+#define PALPACK_H
+
+// The number of palette banks of each kind on the GBA.
+#define MAX_PALETTE_BANKS 16
+
+// Packs the 16-color palettes of a set of indexed PNGs into as few palette
+// banks as possible. Images whose colors fit in the same bank share it: the
+// bank holds the union of their colors, after index 0, which stays the
+// transparent color. Each image is written to its output path as a 4-bit PNG
+// using its bank's palette, and the banks are written to palettePath, one
+// after another, as a .gbapal or JASC .pal file. Paths come in pairs in
+// imagePaths: INPUT_PATH OUTPUT_PATH.
+void PackPalettes(char *palettePath, char **imagePaths, int numImages, int maxBanks);
+
+#endif // PALPACK_H
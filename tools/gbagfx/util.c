@@ -9,6 +9,16 @@
 #include "global.h"
 #include "util.h"
 
+_Thread_local jmp_buf *gErrorJump;
+
+void ExitOnError(void)
+{
+	if (gErrorJump != NULL)
+		longjmp(*gErrorJump, 1);
+
+	exit(1);
+}
+
 bool ParseNumber(char *s, char **end, int radix, int *intValue)
 {
 	char *localEnd;
@@ -109,7 +119,7 @@ unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount)
 
 	rewind(fp);
 
-	if (fread(buffer, *size, 1, fp) != 1)
+	if (*size > 0 && fread(buffer, *size, 1, fp) != 1)
 		FATAL_ERROR("Failed to read \"%s\".\n", path);
 
 	fclose(fp);
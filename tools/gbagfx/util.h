@@ -4,6 +4,11 @@
 #define UTIL_H
 
 #include <stdbool.h>
+#include <setjmp.h>
+
+// While set, errors jump here instead of exiting, so that a batch job can fail
+// without taking down the threads running the other jobs.
+extern _Thread_local jmp_buf *gErrorJump;
 
 bool ParseNumber(char *s, char **end, int radix, int *intValue);
 char *GetFileExtension(char *path);
@@ -0,0 +1,504 @@
+// constants.cpp
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <fstream>
+using std::ifstream;
+
+#include <algorithm>
+using std::find;
+
+#include <cctype>
+
+#include "mapjson.h"
+#include "constants.h"
+
+static string trim(const string &s) {
+    size_t start = s.find_first_not_of(" \t\r");
+    if (start == string::npos)
+        return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(start, end - start + 1);
+}
+
+static bool is_name_start(char c) {
+    return isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == '$';
+}
+
+static bool is_name_char(char c) {
+    return is_name_start(c) || isdigit(static_cast<unsigned char>(c));
+}
+
+static bool starts_with_word(const string &line, const string &word) {
+    return line.compare(0, word.size(), word) == 0
+        && (line.size() == word.size() || line[word.size()] == ' ' || line[word.size()] == '\t');
+}
+
+// Splits at separators outside of strings and parentheses.
+static vector<string> split(const string &text, char separator) {
+    vector<string> pieces(1);
+    bool quoted = false;
+    int parens = 0;
+
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '"' && (i == 0 || text[i - 1] != '\\'))
+            quoted = !quoted;
+        else if (!quoted && c == '(')
+            parens++;
+        else if (!quoted && c == ')')
+            parens--;
+        else if (!quoted && parens == 0 && c == separator) {
+            pieces.push_back("");
+            continue;
+        }
+        pieces.back() += c;
+    }
+
+    return pieces;
+}
+
+// Assembly comments start with @, and run to the end of the line.
+static string strip_comment(const string &line) {
+    bool quoted = false;
+
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"' && (i == 0 || line[i - 1] != '\\'))
+            quoted = !quoted;
+        else if (!quoted && line[i] == '@')
+            return line.substr(0, i);
+    }
+
+    return line;
+}
+
+static string first_word(const string &statement) {
+    size_t end = statement.find_first_of(" \t");
+    return statement.substr(0, end);
+}
+
+static string after_first_word(const string &statement) {
+    size_t end = statement.find_first_of(" \t");
+    return end == string::npos ? "" : trim(statement.substr(end));
+}
+
+// The maximum nesting of macro invocations, as a guard against recursion.
+static const int MAX_MACRO_DEPTH = 100;
+
+Constants::Constants() : recording(nullptr), recording_depth(0) {}
+
+void Constants::load(const string &filepath) {
+    ifstream in_file(filepath);
+
+    if (!in_file.is_open())
+        FATAL_ERROR("Cannot open file %s for reading.\n", filepath.c_str());
+
+    string line;
+
+    while (getline(in_file, line)) {
+        line = trim(line);
+
+        if (recording == nullptr && starts_with_word(line, "#define")) {
+            string definition = trim(line.substr(7));
+            size_t name_end = 0;
+            while (name_end < definition.size() && is_name_char(definition[name_end]))
+                name_end++;
+            // Function-like macros aren't constants.
+            if (name_end == 0 || (name_end < definition.size() && definition[name_end] == '('))
+                continue;
+            defines[definition.substr(0, name_end)] = trim(definition.substr(name_end));
+        } else if (recording == nullptr && starts_with_word(line, "#undef")) {
+            defines.erase(trim(line.substr(6)));
+        } else if (line.empty() || line[0] == '#') {
+            // Line markers and other directives left by cpp.
+            continue;
+        } else {
+            run_line(line, 0);
+        }
+    }
+
+    recording = nullptr;
+}
+
+void Constants::run_line(const string &line, int depth) {
+    string code = trim(strip_comment(line));
+
+    if (recording != nullptr) {
+        string directive = first_word(code);
+        if (directive == ".macro")
+            recording_depth++;
+        if (directive == ".endm" && --recording_depth == 0)
+            recording = nullptr;
+        else
+            recording->body.push_back(code);
+        return;
+    }
+
+    for (const string &statement : split(code, ';'))
+        run_statement(trim(statement), depth);
+}
+
+void Constants::run_statement(const string &statement, int depth) {
+    string code = statement;
+
+    // Labels don't matter to constants.
+    size_t colon = code.find(':');
+    if (colon != string::npos && colon > 0 && is_name_start(code[0])) {
+        size_t i = 0;
+        while (i < colon && is_name_char(code[i]))
+            i++;
+        if (i == colon)
+            code = trim(code.substr(colon + (code.compare(colon, 2, "::") == 0 ? 2 : 1)));
+    }
+
+    if (code.empty())
+        return;
+
+    string directive = first_word(code);
+    string operands = after_first_word(code);
+
+    if (directive == ".macro") {
+        vector<string> header;
+        for (const string &piece : split(operands, ','))
+            for (const string &word : split(trim(piece), ' '))
+                if (!trim(word).empty())
+                    header.push_back(trim(word));
+
+        if (header.empty())
+            return;
+
+        Macro &macro = macros[header[0]];
+        macro = Macro();
+        for (size_t i = 1; i < header.size(); i++) {
+            string param = header[i];
+            size_t equals = param.find('=');
+            string default_value = equals != string::npos ? param.substr(equals + 1) : "";
+            param = param.substr(0, std::min(equals, param.find(':')));
+            macro.params.push_back(param);
+            macro.defaults.push_back(default_value);
+        }
+
+        recording = &macro;
+        recording_depth = 1;
+    } else if (directive == ".set" || directive == ".equ" || directive == ".equiv" || directive == ".eqv") {
+        size_t comma = operands.find(',');
+        if (comma != string::npos)
+            set_symbol(trim(operands.substr(0, comma)), trim(operands.substr(comma + 1)));
+    } else if (depth < MAX_MACRO_DEPTH) {
+        auto macro = macros.find(directive);
+        if (macro != macros.end())
+            invoke(macro->second, operands, depth + 1);
+    }
+}
+
+void Constants::invoke(const Macro &macro, const string &args, int depth) {
+    vector<string> values = macro.defaults;
+    size_t position = 0;
+
+    if (!args.empty()) {
+        for (string arg : split(args, ',')) {
+            arg = trim(arg);
+
+            // Named arguments, like "allow_running=TRUE".
+            size_t equals = arg.find('=');
+            if (equals != string::npos && arg.compare(equals, 2, "==") != 0) {
+                string name = trim(arg.substr(0, equals));
+                auto param = find(macro.params.begin(), macro.params.end(), name);
+                if (param != macro.params.end()) {
+                    values[param - macro.params.begin()] = trim(arg.substr(equals + 1));
+                    continue;
+                }
+            }
+
+            if (position < values.size())
+                values[position] = arg;
+            position++;
+        }
+    }
+
+    for (const string &body_line : macro.body) {
+        string line;
+
+        for (size_t i = 0; i < body_line.size(); i++) {
+            if (body_line[i] != '\\') {
+                line += body_line[i];
+                continue;
+            }
+            if (body_line.compare(i, 3, "\\()") == 0) {
+                i += 2;
+                continue;
+            }
+
+            size_t end = i + 1;
+            while (end < body_line.size() && is_name_char(body_line[end]))
+                end++;
+            string name = body_line.substr(i + 1, end - i - 1);
+            auto param = find(macro.params.begin(), macro.params.end(), name);
+
+            if (param != macro.params.end()) {
+                line += values[param - macro.params.begin()];
+                i = end - 1;
+            } else {
+                line += body_line[i];
+            }
+        }
+
+        run_line(line, depth);
+    }
+}
+
+// Like gas, a symbol takes the value of its expression when it's set, so that
+// ".set x, x + 1" counts. Expressions that can't be evaluated yet are kept to
+// evaluate when the symbol is used.
+void Constants::set_symbol(const string &name, const string &expression) {
+    long long value;
+
+    cache.clear();
+    unresolved.clear();
+
+    if (evaluate(expression, value)) {
+        symbol_values[name] = value;
+        symbols.erase(name);
+    } else {
+        symbols[name] = expression;
+        symbol_values.erase(name);
+    }
+
+    cache.clear();
+    unresolved.clear();
+}
+
+bool Constants::tokenize(const string &text, vector<Token> &tokens) {
+    static const char *const operators[] = {
+        "<<", ">>", "==", "!=", "<>", "<=", ">=", "&&", "||",
+        "+", "-", "*", "/", "%", "&", "|", "^", "~", "!", "(", ")", "<", ">",
+    };
+
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+
+        if (isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (isdigit(static_cast<unsigned char>(c))) {
+            size_t end;
+            long long number;
+            try {
+                number = std::stoll(text.substr(i), &end, 0);
+            } catch (const std::exception &) {
+                return false;
+            }
+            i += end;
+            // Integer suffixes from C headers.
+            while (i < text.size() && (text[i] == 'u' || text[i] == 'U' || text[i] == 'l' || text[i] == 'L'))
+                i++;
+            if (i < text.size() && is_name_char(text[i]))
+                return false;
+            tokens.push_back(Token{Token::NUMBER, "", number});
+        } else if (is_name_start(c)) {
+            size_t start = i;
+            while (i < text.size() && is_name_char(text[i]))
+                i++;
+            tokens.push_back(Token{Token::NAME, text.substr(start, i - start), 0});
+        } else {
+            const char *op = nullptr;
+            for (const char *candidate : operators) {
+                if (text.compare(i, string(candidate).size(), candidate) == 0) {
+                    op = candidate;
+                    break;
+                }
+            }
+            if (op == nullptr)
+                return false;
+            tokens.push_back(Token{Token::OPERATOR, op, 0});
+            i += string(op).size();
+        }
+    }
+
+    return true;
+}
+
+// Substitutes #defines the way cpp does: a macro isn't expanded again inside
+// its own expansion.
+bool Constants::expand(const string &text, vector<Token> &tokens, vector<string> &expanding) {
+    vector<Token> raw;
+    if (!tokenize(text, raw))
+        return false;
+
+    for (const Token &token : raw) {
+        if (token.kind == Token::NAME && find(expanding.begin(), expanding.end(), token.text) == expanding.end()) {
+            auto define = defines.find(token.text);
+            if (define != defines.end()) {
+                expanding.push_back(token.text);
+                bool expanded = expand(define->second, tokens, expanding);
+                expanding.pop_back();
+                if (!expanded)
+                    return false;
+                continue;
+            }
+        }
+        tokens.push_back(token);
+    }
+
+    return true;
+}
+
+bool Constants::symbol_value(const string &name, long long &value) {
+    auto known = symbol_values.find(name);
+    if (known != symbol_values.end()) {
+        value = known->second;
+        return true;
+    }
+
+    auto symbol = symbols.find(name);
+    if (symbol == symbols.end() || evaluating.count(name))
+        return false;
+
+    evaluating.insert(name);
+    bool resolved = evaluate(symbol->second, value);
+    evaluating.erase(name);
+
+    if (resolved)
+        symbol_values[name] = value;
+    return resolved;
+}
+
+// Binary operator ranks, from gas's expr.c. Unlike C, shifts bind as tightly
+// as multiplication, and the bitwise operators more tightly than addition.
+static int operator_rank(const string &op) {
+    if (op == "*" || op == "/" || op == "%" || op == "<<" || op == ">>")
+        return 9;
+    if (op == "|" || op == "&" || op == "^" || op == "!")
+        return 8;
+    if (op == "+" || op == "-")
+        return 7;
+    if (op == "==" || op == "!=" || op == "<>" || op == "<" || op == "<=" || op == ">" || op == ">=")
+        return 4;
+    if (op == "&&")
+        return 3;
+    if (op == "||")
+        return 2;
+    return 0;
+}
+
+static bool apply_operator(const string &op, long long left, long long right, long long &result) {
+    typedef unsigned long long u64;
+
+    // Comparisons are -1 when true, as in gas.
+    if (op == "*") result = static_cast<long long>(static_cast<u64>(left) * static_cast<u64>(right));
+    else if (op == "/" || op == "%") {
+        if (right == 0)
+            return false;
+        result = op == "/" ? left / right : left % right;
+    }
+    else if (op == "<<") result = right >= 64 ? 0 : static_cast<long long>(static_cast<u64>(left) << right);
+    else if (op == ">>") result = right >= 64 ? 0 : static_cast<long long>(static_cast<u64>(left) >> right);
+    else if (op == "|") result = left | right;
+    else if (op == "&") result = left & right;
+    else if (op == "^") result = left ^ right;
+    else if (op == "!") result = left | ~right;
+    else if (op == "+") result = static_cast<long long>(static_cast<u64>(left) + static_cast<u64>(right));
+    else if (op == "-") result = static_cast<long long>(static_cast<u64>(left) - static_cast<u64>(right));
+    else if (op == "==") result = left == right ? -1 : 0;
+    else if (op == "!=" || op == "<>") result = left != right ? -1 : 0;
+    else if (op == "<") result = left < right ? -1 : 0;
+    else if (op == "<=") result = left <= right ? -1 : 0;
+    else if (op == ">") result = left > right ? -1 : 0;
+    else if (op == ">=") result = left >= right ? -1 : 0;
+    else if (op == "&&") result = left && right;
+    else if (op == "||") result = left || right;
+    else return false;
+
+    return true;
+}
+
+bool Constants::parse_operand(const vector<Token> &tokens, size_t &pos, long long &value) {
+    if (pos >= tokens.size())
+        return false;
+
+    const Token &token = tokens[pos++];
+
+    switch (token.kind) {
+        case Token::NUMBER:
+            value = token.number;
+            return true;
+        case Token::NAME:
+            return symbol_value(token.text, value);
+        case Token::OPERATOR:
+            if (token.text == "(") {
+                if (!parse_binary(tokens, pos, 1, value))
+                    return false;
+                return pos < tokens.size() && tokens[pos++].text == ")";
+            }
+            if (!parse_operand(tokens, pos, value))
+                return false;
+            if (token.text == "-") value = static_cast<long long>(0ULL - static_cast<unsigned long long>(value));
+            else if (token.text == "~") value = ~value;
+            else if (token.text == "!") value = !value;
+            else if (token.text != "+") return false;
+            return true;
+    }
+
+    return false;
+}
+
+bool Constants::parse_binary(const vector<Token> &tokens, size_t &pos, int min_rank, long long &value) {
+    if (!parse_operand(tokens, pos, value))
+        return false;
+
+    while (pos < tokens.size() && tokens[pos].kind == Token::OPERATOR) {
+        const string &op = tokens[pos].text;
+        int rank = operator_rank(op);
+        if (rank == 0 || rank < min_rank)
+            break;
+        pos++;
+
+        long long right;
+        if (!parse_binary(tokens, pos, rank + 1, right) || !apply_operator(op, value, right, value))
+            return false;
+    }
+
+    return true;
+}
+
+bool Constants::evaluate(const string &expression, long long &value) {
+    auto known = cache.find(expression);
+    if (known != cache.end()) {
+        value = known->second;
+        return true;
+    }
+    if (unresolved.count(expression))
+        return false;
+
+    vector<Token> tokens;
+    vector<string> expanding;
+    size_t pos = 0;
+
+    bool resolved = expand(expression, tokens, expanding)
+                 && parse_binary(tokens, pos, 1, value)
+                 && pos == tokens.size();
+
+    // Values of .set symbols can depend on each other, so only cache results
+    // that don't come from a symbol still being evaluated.
+    if (evaluating.empty()) {
+        if (resolved)
+            cache[expression] = value;
+        else
+            unresolved.insert(expression);
+    }
+
+    return resolved;
+}
+
+long long Constants::value(const string &expression) {
+    long long value;
+
+    if (!evaluate(expression, value))
+        FATAL_ERROR("Failed to resolve '%s' to a constant.\n", expression.c_str());
+
+    return value;
+}
@@ -0,0 +1,66 @@
+// constants.h
+
+#ifndef CONSTANTS_H
+#define CONSTANTS_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Resolves the constants that map data refers to, the way the assembler sees
+// them after the C preprocessor: #defines are substituted as text, and symbols
+// set with .set, .equ or .equiv have the value of their expression.
+class Constants {
+public:
+    Constants();
+
+    // Reads the include files of a .s file the way the assembler gets them,
+    // after preproc and cpp -dD: "#define NAME VALUE" and #undef lines, and the
+    // .set, .equ and .equiv directives of the assembly, including those run by
+    // macros. Other directives and function-like #defines are skipped, and
+    // conditional assembly isn't evaluated.
+    void load(const std::string &filepath);
+
+    // Evaluates an expression with the operators and precedence of the GNU
+    // assembler. Returns false if it refers to anything that isn't a constant.
+    bool evaluate(const std::string &expression, long long &value);
+
+    // Like evaluate, but fails with an error naming the expression.
+    long long value(const std::string &expression);
+
+private:
+    struct Token {
+        enum Kind { NUMBER, NAME, OPERATOR } kind;
+        std::string text;
+        long long number;
+    };
+
+    struct Macro {
+        std::vector<std::string> params;
+        std::vector<std::string> defaults;
+        std::vector<std::string> body;
+    };
+
+    std::unordered_map<std::string, std::string> defines;
+    std::unordered_map<std::string, Macro> macros;
+    Macro *recording;
+    int recording_depth;
+    std::unordered_map<std::string, std::string> symbols;
+    std::unordered_map<std::string, long long> symbol_values;
+    std::unordered_set<std::string> evaluating;
+    std::unordered_map<std::string, long long> cache;
+    std::unordered_set<std::string> unresolved;
+
+    void run_line(const std::string &line, int depth);
+    void run_statement(const std::string &statement, int depth);
+    void invoke(const Macro &macro, const std::string &args, int depth);
+    void set_symbol(const std::string &name, const std::string &expression);
+    bool tokenize(const std::string &text, std::vector<Token> &tokens);
+    bool expand(const std::string &text, std::vector<Token> &tokens, std::vector<std::string> &expanding);
+    bool symbol_value(const std::string &name, long long &value);
+    bool parse_binary(const std::vector<Token> &tokens, size_t &pos, int min_rank, long long &value);
+    bool parse_operand(const std::vector<Token> &tokens, size_t &pos, long long &value);
+};
+
+#endif // CONSTANTS_H
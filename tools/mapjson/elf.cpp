@@ -0,0 +1,248 @@
+// elf.cpp
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <fstream>
+using std::ifstream; using std::ofstream;
+
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+
+#include "mapjson.h"
+#include "elf.h"
+
+// Section header indices of the object.
+enum {
+    SECTION_NULL,
+    SECTION_RODATA,
+    SECTION_REL_RODATA,
+    SECTION_SYMTAB,
+    SECTION_STRTAB,
+    SECTION_SHSTRTAB,
+    SECTION_COUNT,
+};
+
+static const uint32_t SHT_PROGBITS = 1;
+static const uint32_t SHT_SYMTAB = 2;
+static const uint32_t SHT_STRTAB = 3;
+static const uint32_t SHT_REL = 9;
+static const uint32_t SHF_ALLOC = 0x2;
+static const uint32_t SHF_INFO_LINK = 0x40;
+static const uint8_t STB_LOCAL = 0;
+static const uint8_t STB_GLOBAL = 1;
+static const uint8_t STT_NOTYPE = 0;
+static const uint8_t STT_SECTION = 3;
+static const uint32_t R_ARM_ABS32 = 2;
+
+static void put16(vector<unsigned char> &out, uint32_t value) {
+    out.push_back(value & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+}
+
+static void put32(vector<unsigned char> &out, uint32_t value) {
+    put16(out, value & 0xFFFF);
+    put16(out, value >> 16);
+}
+
+static void pad_to(vector<unsigned char> &out, size_t alignment) {
+    while (out.size() % alignment != 0)
+        out.push_back(0);
+}
+
+static uint32_t add_string(vector<unsigned char> &table, const string &s) {
+    uint32_t offset = table.size();
+    table.insert(table.end(), s.begin(), s.end());
+    table.push_back(0);
+    return offset;
+}
+
+ElfObject::ElfObject() : alignment_power(0) {}
+
+void ElfObject::byte(long long value) {
+    data.push_back(value & 0xFF);
+}
+
+void ElfObject::hword(long long value) {
+    byte(value);
+    byte(value >> 8);
+}
+
+void ElfObject::word(long long value) {
+    hword(value);
+    hword(value >> 16);
+}
+
+void ElfObject::space(size_t size) {
+    data.insert(data.end(), size, 0);
+}
+
+void ElfObject::align(int power) {
+    pad_to(data, static_cast<size_t>(1) << power);
+    if (power > alignment_power)
+        alignment_power = power;
+}
+
+void ElfObject::incbin(const string &filepath) {
+    ifstream in_file(filepath, std::ios::binary);
+
+    if (!in_file.is_open())
+        FATAL_ERROR("Cannot open file %s for reading.\n", filepath.c_str());
+
+    data.insert(data.end(), std::istreambuf_iterator<char>(in_file), std::istreambuf_iterator<char>());
+}
+
+size_t ElfObject::find_symbol(const string &name) {
+    auto found = symbol_indices.find(name);
+    if (found != symbol_indices.end())
+        return found->second;
+
+    symbols.push_back(Symbol{name, 0, false, false});
+    symbol_indices[name] = symbols.size() - 1;
+    return symbols.size() - 1;
+}
+
+void ElfObject::label(const string &name, bool global) {
+    Symbol &symbol = symbols[find_symbol(name)];
+
+    if (symbol.defined)
+        FATAL_ERROR("Symbol %s is already defined.\n", name.c_str());
+
+    symbol.offset = data.size();
+    symbol.defined = true;
+    symbol.global = global;
+}
+
+void ElfObject::word_symbol(const string &name) {
+    relocations.push_back(Relocation{data.size(), find_symbol(name)});
+    word(0);
+}
+
+void ElfObject::write(const string &filepath) const {
+    vector<unsigned char> strtab(1, 0);
+    vector<unsigned char> symtab(16, 0);
+    vector<uint32_t> elf_indices(symbols.size());
+    uint32_t elf_index = 1;
+
+    // The section symbol comes first, then local symbols, then global ones.
+    put32(symtab, 0);
+    put32(symtab, 0);
+    put32(symtab, 0);
+    symtab.push_back((STB_LOCAL << 4) | STT_SECTION);
+    symtab.push_back(0);
+    put16(symtab, SECTION_RODATA);
+    elf_index++;
+
+    uint32_t first_global = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        bool globals = pass == 1;
+        if (globals)
+            first_global = elf_index;
+
+        for (size_t i = 0; i < symbols.size(); i++) {
+            const Symbol &symbol = symbols[i];
+            bool global = symbol.global || !symbol.defined;
+            if (global != globals)
+                continue;
+
+            put32(symtab, add_string(strtab, symbol.name));
+            put32(symtab, symbol.defined ? symbol.offset : 0);
+            put32(symtab, 0);
+            symtab.push_back(((global ? STB_GLOBAL : STB_LOCAL) << 4) | STT_NOTYPE);
+            symtab.push_back(0);
+            put16(symtab, symbol.defined ? SECTION_RODATA : 0);
+            elf_indices[i] = elf_index++;
+        }
+    }
+
+    // As with gas, pointers to local symbols are relocated against the
+    // section, with the symbol's offset stored in place as the addend.
+    vector<unsigned char> rodata = data;
+    vector<unsigned char> rel;
+    for (const Relocation &relocation : relocations) {
+        const Symbol &symbol = symbols[relocation.symbol];
+        uint32_t target = elf_indices[relocation.symbol];
+
+        if (symbol.defined && !symbol.global) {
+            target = 1;
+            for (int i = 0; i < 4; i++)
+                rodata[relocation.offset + i] = (symbol.offset >> (8 * i)) & 0xFF;
+        }
+
+        put32(rel, relocation.offset);
+        put32(rel, (target << 8) | R_ARM_ABS32);
+    }
+
+    vector<unsigned char> shstrtab(1, 0);
+    uint32_t names[SECTION_COUNT] = {};
+    names[SECTION_RODATA] = add_string(shstrtab, ".rodata");
+    names[SECTION_REL_RODATA] = add_string(shstrtab, ".rel.rodata");
+    names[SECTION_SYMTAB] = add_string(shstrtab, ".symtab");
+    names[SECTION_STRTAB] = add_string(shstrtab, ".strtab");
+    names[SECTION_SHSTRTAB] = add_string(shstrtab, ".shstrtab");
+
+    const vector<unsigned char> *contents[SECTION_COUNT] = { nullptr, &rodata, &rel, &symtab, &strtab, &shstrtab };
+    uint32_t offsets[SECTION_COUNT] = {};
+
+    vector<unsigned char> out(52, 0);
+    for (int i = SECTION_RODATA; i < SECTION_COUNT; i++) {
+        pad_to(out, 4);
+        offsets[i] = out.size();
+        out.insert(out.end(), contents[i]->begin(), contents[i]->end());
+    }
+    pad_to(out, 4);
+    uint32_t section_headers = out.size();
+
+    struct SectionHeader {
+        uint32_t type, flags, link, info, align, entsize;
+    } headers[SECTION_COUNT] = {
+        { 0, 0, 0, 0, 0, 0 },
+        { SHT_PROGBITS, SHF_ALLOC, 0, 0, static_cast<uint32_t>(1) << alignment_power, 0 },
+        { SHT_REL, SHF_INFO_LINK, SECTION_SYMTAB, SECTION_RODATA, 4, 8 },
+        { SHT_SYMTAB, 0, SECTION_STRTAB, first_global, 4, 16 },
+        { SHT_STRTAB, 0, 0, 0, 1, 0 },
+        { SHT_STRTAB, 0, 0, 0, 1, 0 },
+    };
+
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        put32(out, names[i]);
+        put32(out, headers[i].type);
+        put32(out, headers[i].flags);
+        put32(out, 0); // sh_addr
+        put32(out, offsets[i]);
+        put32(out, contents[i] ? contents[i]->size() : 0);
+        put32(out, headers[i].link);
+        put32(out, headers[i].info);
+        put32(out, headers[i].align);
+        put32(out, headers[i].entsize);
+    }
+
+    // ELF header: 32-bit little-endian relocatable object for ARM, EABI version 5.
+    vector<unsigned char> header = { 0x7F, 'E', 'L', 'F', 1, 1, 1 };
+    header.resize(16, 0);
+    put16(header, 1);          // e_type: ET_REL
+    put16(header, 40);         // e_machine: EM_ARM
+    put32(header, 1);          // e_version
+    put32(header, 0);          // e_entry
+    put32(header, 0);          // e_phoff
+    put32(header, section_headers);
+    put32(header, 0x05000000); // e_flags
+    put16(header, 52);         // e_ehsize
+    put16(header, 0);          // e_phentsize
+    put16(header, 0);          // e_phnum
+    put16(header, 40);         // e_shentsize
+    put16(header, SECTION_COUNT);
+    put16(header, SECTION_SHSTRTAB);
+    std::copy(header.begin(), header.end(), out.begin());
+
+    ofstream out_file(filepath, std::ios::binary);
+
+    if (!out_file.is_open())
+        FATAL_ERROR("Cannot open file %s for writing.\n", filepath.c_str());
+
+    out_file.write(reinterpret_cast<const char *>(out.data()), out.size());
+}
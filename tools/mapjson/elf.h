@@ -0,0 +1,54 @@
+// elf.h
+
+#ifndef ELF_H
+#define ELF_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Builds a relocatable 32-bit ARM ELF object holding a single .rodata section,
+// the way the assembler would from data directives and labels.
+class ElfObject {
+public:
+    ElfObject();
+
+    void byte(long long value);
+    void hword(long long value);
+    void word(long long value);
+    void space(size_t size);
+    // Pads with zeros to a multiple of 2^power bytes, like ".align power".
+    void align(int power);
+    void incbin(const std::string &filepath);
+
+    // Defines a symbol at the current offset: "name::" when global, "name:"
+    // otherwise.
+    void label(const std::string &name, bool global);
+    // A 4-byte pointer to a symbol, defined in this object or not.
+    void word_symbol(const std::string &name);
+
+    void write(const std::string &filepath) const;
+
+private:
+    struct Symbol {
+        std::string name;
+        size_t offset;
+        bool defined;
+        bool global;
+    };
+
+    struct Relocation {
+        size_t offset;
+        size_t symbol;
+    };
+
+    std::vector<unsigned char> data;
+    std::vector<Symbol> symbols;
+    std::unordered_map<std::string, size_t> symbol_indices;
+    std::vector<Relocation> relocations;
+    int alignment_power;
+
+    size_t find_symbol(const std::string &name);
+};
+
+#endif // ELF_H
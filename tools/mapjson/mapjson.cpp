@@ -10,7 +10,7 @@ using std::string;
 using std::vector;
 
 #include <algorithm>
-using std::sort; using std::find;
+using std::sort; using std::stable_sort; using std::find;
 
 #include <map>
 using std::map;
@@ -18,16 +18,28 @@ using std::map;
 #include <fstream>
 using std::ofstream; using std::ifstream;
 
-#include <sstream>
-using std::ostringstream;
+#include <unordered_map>
+using std::unordered_map;
 
 #include <limits>
 using std::numeric_limits;
 
+#include <atomic>
+using std::atomic;
+
+#include <thread>
+using std::thread;
+
+#include <functional>
+
+#include <cctype>
+
 #include "json11.h"
 using json11::Json;
 
 #include "mapjson.h"
+#include "constants.h"
+#include "elf.h"
 
 string version;
 // System directory separator
@@ -52,7 +64,27 @@ string read_text_file(string filepath) {
     return text;
 }
 
-void write_text_file(string filepath, string text) {
+// Leaves the file alone if it already holds the text, so that make doesn't
+// rebuild everything that depends on it.
+void write_text_file(string filepath, const string &text) {
+    ifstream in_file(filepath, std::ifstream::binary);
+
+    if (in_file.is_open()) {
+        in_file.seekg(0, std::ios::end);
+
+        if (in_file.tellg() == static_cast<std::streamoff>(text.size())) {
+            string old_text(text.size(), '\0');
+
+            in_file.seekg(0, std::ios::beg);
+            in_file.read(&old_text[0], old_text.size());
+
+            if (in_file && old_text == text)
+                return;
+        }
+
+        in_file.close();
+    }
+
     ofstream out_file(filepath, std::ofstream::binary);
 
     if (!out_file.is_open())
@@ -63,22 +95,22 @@ void write_text_file(string filepath, string text) {
     out_file.close();
 }
 
-
-string json_to_string(const Json &data, const string &field = "", bool silent = false) {
-    const Json value = !field.empty() ? data[field] : data;
-    string output = "";
+// Appends a JSON value the way the generated files spell it: strings as they
+// are, numbers in decimal, and bools as TRUE or FALSE.
+void append_json_value(string &output, const Json &data, const string &field, bool silent) {
+    const Json &value = !field.empty() ? data[field] : data;
+    size_t start = output.size();
     switch (value.type()) {
         case Json::Type::STRING:
-            output = value.string_value();
+            output += value.string_value();
             break;
         case Json::Type::NUMBER:
-            output = std::to_string(value.int_value());
+            output += std::to_string(value.int_value());
             break;
         case Json::Type::BOOL:
-            output = value.bool_value() ? "TRUE" : "FALSE";
+            output += value.bool_value() ? "TRUE" : "FALSE";
             break;
         case Json::Type::NUL:
-            output = "";
             break;
         default:{
             if (!silent) {
@@ -88,86 +120,138 @@ string json_to_string(const Json &data, const string &field = "", bool silent =
         }
     }
 
-    if (!silent && output.empty()) {
+    if (!silent && output.size() == start) {
         string s = !field.empty() ? ("Value for '" + field + "'") : "JSON field";
         FATAL_ERROR("%s cannot be empty.\n", s.c_str());
     }
+}
 
+string json_to_string(const Json &data, const string &field = "", bool silent = false) {
+    string output;
+    append_json_value(output, data, field, silent);
     return output;
 }
 
-string generate_map_header_text(Json map_data, Json layouts_data) {
-    string map_layout_id = json_to_string(map_data, "layout");
+// A JSON value to be written out by an Emitter, like json_to_string.
+struct JsonField {
+    const Json &data;
+    const char *field;
+    bool silent;
+};
 
-    vector<Json> matched;
+JsonField json_field(const Json &data, const char *field = "", bool silent = false) {
+    return JsonField{data, field, silent};
+}
 
-    for (auto &layout : layouts_data["layouts"].array_items()) {
-        if (map_layout_id == json_to_string(layout, "id", true))
-            matched.push_back(layout);
+// Builds the text of a generated file. The buffer keeps its capacity when it
+// is cleared, so one emitter can produce file after file without allocating,
+// and JSON values are appended to it without copies in between.
+class Emitter {
+public:
+    void clear() { buffer.clear(); }
+    const string &str() const { return buffer; }
+
+    Emitter &operator<<(const string &s) { buffer += s; return *this; }
+    Emitter &operator<<(const char *s) { buffer += s; return *this; }
+    Emitter &operator<<(long long n) { buffer += std::to_string(n); return *this; }
+
+    Emitter &operator<<(const JsonField &value) {
+        append_json_value(buffer, value.data, value.field, value.silent);
+        return *this;
     }
 
-    if (matched.size() != 1)
+private:
+    string buffer;
+};
+
+// Layouts by id, so that a map finds its layout without scanning them all.
+// An id shared by several layouts maps to null.
+typedef unordered_map<string, const Json *> LayoutIndex;
+
+LayoutIndex index_layouts(const Json &layouts_data) {
+    LayoutIndex layouts;
+
+    for (const Json &layout : layouts_data["layouts"].array_items()) {
+        auto inserted = layouts.emplace(json_to_string(layout, "id", true), &layout);
+        if (!inserted.second)
+            inserted.first->second = nullptr;
+    }
+
+    return layouts;
+}
+
+bool has_field(const Json &data, const string &field) {
+    return data.object_items().find(field) != data.object_items().end();
+}
+
+const Json &find_layout(const Json &map_data, const LayoutIndex &layouts) {
+    string map_layout_id = json_to_string(map_data, "layout");
+
+    auto found = layouts.find(map_layout_id);
+    if (found == layouts.end() || found->second == nullptr)
         FATAL_ERROR("Failed to find matching layout for %s.\n", map_layout_id.c_str());
 
-    Json layout = matched[0];
+    return *found->second;
+}
 
-    ostringstream text;
+void generate_map_header_text(Emitter &text, const Json &map_data, const LayoutIndex &layouts) {
+    const Json &layout = find_layout(map_data, layouts);
 
     string mapName = json_to_string(map_data, "name");
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/" << mapName << "/map.json\n@\n\n";
 
     text << mapName << ":\n"
-         << "\t.4byte " << json_to_string(layout, "name") << "\n";
+         << "\t.4byte " << json_field(layout, "name") << "\n";
 
-    if (map_data.object_items().find("shared_events_map") != map_data.object_items().end())
-        text << "\t.4byte " << json_to_string(map_data, "shared_events_map") << "_MapEvents\n";
+    if (has_field(map_data, "shared_events_map"))
+        text << "\t.4byte " << json_field(map_data, "shared_events_map") << "_MapEvents\n";
     else
         text << "\t.4byte " << mapName << "_MapEvents\n";
 
-    if (map_data.object_items().find("shared_scripts_map") != map_data.object_items().end())
-        text << "\t.4byte " << json_to_string(map_data, "shared_scripts_map") << "_MapScripts\n";
+    if (has_field(map_data, "shared_scripts_map"))
+        text << "\t.4byte " << json_field(map_data, "shared_scripts_map") << "_MapScripts\n";
     else
         text << "\t.4byte " << mapName << "_MapScripts\n";
 
-    if (map_data.object_items().find("connections") != map_data.object_items().end()
+    if (has_field(map_data, "connections")
      && map_data["connections"].array_items().size() > 0 && json_to_string(map_data, "connections_no_include", true) != "TRUE")
         text << "\t.4byte " << mapName << "_MapConnections\n";
     else
         text << "\t.4byte NULL\n";
 
-    text << "\t.2byte " << json_to_string(map_data, "music") << "\n"
-         << "\t.2byte " << json_to_string(layout, "id") << "\n"
-         << "\t.byte "  << json_to_string(map_data, "region_map_section") << "\n"
-         << "\t.byte "  << json_to_string(map_data, "requires_flash") << "\n"
-         << "\t.byte "  << json_to_string(map_data, "weather") << "\n"
-         << "\t.byte "  << json_to_string(map_data, "map_type") << "\n";
+    text << "\t.2byte " << json_field(map_data, "music") << "\n"
+         << "\t.2byte " << json_field(layout, "id") << "\n"
+         << "\t.byte "  << json_field(map_data, "region_map_section") << "\n"
+         << "\t.byte "  << json_field(map_data, "requires_flash") << "\n"
+         << "\t.byte "  << json_field(map_data, "weather") << "\n"
+         << "\t.byte "  << json_field(map_data, "map_type") << "\n";
 
     if (version != "firered")
         text << "\t.2byte 0\n";
 
     if (version == "ruby")
-        text << "\t.byte " << json_to_string(map_data, "show_map_name") << "\n";
+        text << "\t.byte " << json_field(map_data, "show_map_name") << "\n";
     else if (version == "emerald" || version == "firered")
         text << "\tmap_header_flags "
-             << "allow_cycling=" << json_to_string(map_data, "allow_cycling") << ", "
-             << "allow_escaping=" << json_to_string(map_data, "allow_escaping") << ", "
-             << "allow_running=" << json_to_string(map_data, "allow_running") << ", "
-             << "show_map_name=" << json_to_string(map_data, "show_map_name") << "\n";
+             << "allow_cycling=" << json_field(map_data, "allow_cycling") << ", "
+             << "allow_escaping=" << json_field(map_data, "allow_escaping") << ", "
+             << "allow_running=" << json_field(map_data, "allow_running") << ", "
+             << "show_map_name=" << json_field(map_data, "show_map_name") << "\n";
 
     if (version == "firered")
-        text << "\t.byte " << json_to_string(map_data, "floor_number") << "\n";
+        text << "\t.byte " << json_field(map_data, "floor_number") << "\n";
 
-     text << "\t.byte " << json_to_string(map_data, "battle_scene") << "\n\n";
-
-    return text.str();
+     text << "\t.byte " << json_field(map_data, "battle_scene") << "\n\n";
 }
 
-string generate_map_connections_text(Json map_data) {
-    if (map_data["connections"] == Json())
-        return string("\n");
+void generate_map_connections_text(Emitter &text, const Json &map_data) {
+    const Json &connections = map_data["connections"];
 
-    ostringstream text;
+    if (connections == Json()) {
+        text << "\n";
+        return;
+    }
 
     string mapName = json_to_string(map_data, "name");
 
@@ -175,25 +259,23 @@ string generate_map_connections_text(Json map_data) {
 
     text << mapName << "_MapConnectionsList:\n";
 
-    for (auto &connection : map_data["connections"].array_items()) {
+    for (const Json &connection : connections.array_items()) {
         text << "\tconnection "
-             << json_to_string(connection, "direction") << ", "
-             << json_to_string(connection, "offset") << ", "
-             << json_to_string(connection, "map") << "\n";
+             << json_field(connection, "direction") << ", "
+             << json_field(connection, "offset") << ", "
+             << json_field(connection, "map") << "\n";
     }
 
     text << "\n" << mapName << "_MapConnections:\n"
-         << "\t.4byte " << map_data["connections"].array_items().size() << "\n"
+         << "\t.4byte " << static_cast<long long>(connections.array_items().size()) << "\n"
          << "\t.4byte " << mapName << "_MapConnectionsList\n\n";
-
-    return text.str();
 }
 
-string generate_map_events_text(Json map_data) {
-    if (map_data.object_items().find("shared_events_map") != map_data.object_items().end())
-        return string("\n");
-
-    ostringstream text;
+void generate_map_events_text(Emitter &text, const Json &map_data) {
+    if (has_field(map_data, "shared_events_map")) {
+        text << "\n";
+        return;
+    }
 
     string mapName = json_to_string(map_data, "name");
 
@@ -201,34 +283,36 @@ string generate_map_events_text(Json map_data) {
 
     string objects_label, warps_label, coords_label, bgs_label;
 
-    if (map_data["object_events"].array_items().size() > 0) {
+    const Json::array &object_events = map_data["object_events"].array_items();
+
+    if (object_events.size() > 0) {
         objects_label = mapName + "_ObjectEvents";
         text << objects_label << ":\n";
-        for (unsigned int i = 0; i < map_data["object_events"].array_items().size(); i++) {
-            auto obj_event = map_data["object_events"].array_items()[i];
+        for (unsigned int i = 0; i < object_events.size(); i++) {
+            const Json &obj_event = object_events[i];
             string type = json_to_string(obj_event, "type", true);
 
             // If no type field is present, assume it's a regular object event.
             if (type == "" || type == "object") {
                 text << "\tobject_event " << i + 1 << ", "
-                     << json_to_string(obj_event, "graphics_id") << ", "
-                     << json_to_string(obj_event, "x") << ", "
-                     << json_to_string(obj_event, "y") << ", "
-                     << json_to_string(obj_event, "elevation") << ", "
-                     << json_to_string(obj_event, "movement_type") << ", "
-                     << json_to_string(obj_event, "movement_range_x") << ", "
-                     << json_to_string(obj_event, "movement_range_y") << ", "
-                     << json_to_string(obj_event, "trainer_type") << ", "
-                     << json_to_string(obj_event, "trainer_sight_or_berry_tree_id") << ", "
-                     << json_to_string(obj_event, "script") << ", "
-                     << json_to_string(obj_event, "flag") << "\n";
+                     << json_field(obj_event, "graphics_id") << ", "
+                     << json_field(obj_event, "x") << ", "
+                     << json_field(obj_event, "y") << ", "
+                     << json_field(obj_event, "elevation") << ", "
+                     << json_field(obj_event, "movement_type") << ", "
+                     << json_field(obj_event, "movement_range_x") << ", "
+                     << json_field(obj_event, "movement_range_y") << ", "
+                     << json_field(obj_event, "trainer_type") << ", "
+                     << json_field(obj_event, "trainer_sight_or_berry_tree_id") << ", "
+                     << json_field(obj_event, "script") << ", "
+                     << json_field(obj_event, "flag") << "\n";
             } else if (type == "clone") {
                 text << "\tclone_event " << i + 1 << ", "
-                     << json_to_string(obj_event, "graphics_id") << ", "
-                     << json_to_string(obj_event, "x") << ", "
-                     << json_to_string(obj_event, "y") << ", "
-                     << json_to_string(obj_event, "target_local_id") << ", "
-                     << json_to_string(obj_event, "target_map") << "\n";
+                     << json_field(obj_event, "graphics_id") << ", "
+                     << json_field(obj_event, "x") << ", "
+                     << json_field(obj_event, "y") << ", "
+                     << json_field(obj_event, "target_local_id") << ", "
+                     << json_field(obj_event, "target_map") << "\n";
             } else {
                 FATAL_ERROR("Unknown object event type '%s'. Expected 'object' or 'clone'.\n", type.c_str());
             }
@@ -238,42 +322,46 @@ string generate_map_events_text(Json map_data) {
         objects_label = "NULL";
     }
 
-    if (map_data["warp_events"].array_items().size() > 0) {
+    const Json::array &warp_events = map_data["warp_events"].array_items();
+
+    if (warp_events.size() > 0) {
         warps_label = mapName + "_MapWarps";
         text << warps_label << ":\n";
-        for (auto &warp_event : map_data["warp_events"].array_items()) {
+        for (const Json &warp_event : warp_events) {
             text << "\twarp_def "
-                 << json_to_string(warp_event, "x") << ", "
-                 << json_to_string(warp_event, "y") << ", "
-                 << json_to_string(warp_event, "elevation") << ", "
-                 << json_to_string(warp_event, "dest_warp_id") << ", "
-                 << json_to_string(warp_event, "dest_map") << "\n";
+                 << json_field(warp_event, "x") << ", "
+                 << json_field(warp_event, "y") << ", "
+                 << json_field(warp_event, "elevation") << ", "
+                 << json_field(warp_event, "dest_warp_id") << ", "
+                 << json_field(warp_event, "dest_map") << "\n";
         }
         text << "\n";
     } else {
         warps_label = "NULL";
     }
 
-    if (map_data["coord_events"].array_items().size() > 0) {
+    const Json::array &coord_events = map_data["coord_events"].array_items();
+
+    if (coord_events.size() > 0) {
         coords_label = mapName + "_MapCoordEvents";
         text << coords_label << ":\n";
-        for (auto &coord_event : map_data["coord_events"].array_items()) {
+        for (const Json &coord_event : coord_events) {
             string type = json_to_string(coord_event, "type");
             if (type == "trigger") {
                 text << "\tcoord_event "
-                     << json_to_string(coord_event, "x") << ", "
-                     << json_to_string(coord_event, "y") << ", "
-                     << json_to_string(coord_event, "elevation") << ", "
-                     << json_to_string(coord_event, "var") << ", "
-                     << json_to_string(coord_event, "var_value") << ", "
-                     << json_to_string(coord_event, "script") << "\n";
+                     << json_field(coord_event, "x") << ", "
+                     << json_field(coord_event, "y") << ", "
+                     << json_field(coord_event, "elevation") << ", "
+                     << json_field(coord_event, "var") << ", "
+                     << json_field(coord_event, "var_value") << ", "
+                     << json_field(coord_event, "script") << "\n";
             }
             else if (type == "weather") {
                 text << "\tcoord_weather_event "
-                     << json_to_string(coord_event, "x") << ", "
-                     << json_to_string(coord_event, "y") << ", "
-                     << json_to_string(coord_event, "elevation") << ", "
-                     << json_to_string(coord_event, "weather") << "\n";
+                     << json_field(coord_event, "x") << ", "
+                     << json_field(coord_event, "y") << ", "
+                     << json_field(coord_event, "elevation") << ", "
+                     << json_field(coord_event, "weather") << "\n";
             } else {
                 FATAL_ERROR("Unknown coord event type '%s'. Expected 'trigger' or 'weather'.\n", type.c_str());
             }
@@ -283,39 +371,41 @@ string generate_map_events_text(Json map_data) {
         coords_label = "NULL";
     }
 
-    if (map_data["bg_events"].array_items().size() > 0) {
+    const Json::array &bg_events = map_data["bg_events"].array_items();
+
+    if (bg_events.size() > 0) {
         bgs_label = mapName + "_MapBGEvents";
         text << bgs_label << ":\n";
-        for (auto &bg_event : map_data["bg_events"].array_items()) {
+        for (const Json &bg_event : bg_events) {
             string type = json_to_string(bg_event, "type");
             if (type == "sign") {
                 text << "\tbg_sign_event "
-                     << json_to_string(bg_event, "x") << ", "
-                     << json_to_string(bg_event, "y") << ", "
-                     << json_to_string(bg_event, "elevation") << ", "
-                     << json_to_string(bg_event, "player_facing_dir") << ", "
-                     << json_to_string(bg_event, "script") << "\n";
+                     << json_field(bg_event, "x") << ", "
+                     << json_field(bg_event, "y") << ", "
+                     << json_field(bg_event, "elevation") << ", "
+                     << json_field(bg_event, "player_facing_dir") << ", "
+                     << json_field(bg_event, "script") << "\n";
             }
             else if (type == "hidden_item") {
                 text << "\tbg_hidden_item_event "
-                     << json_to_string(bg_event, "x") << ", "
-                     << json_to_string(bg_event, "y") << ", "
-                     << json_to_string(bg_event, "elevation") << ", "
-                     << json_to_string(bg_event, "item") << ", "
-                     << json_to_string(bg_event, "flag");
+                     << json_field(bg_event, "x") << ", "
+                     << json_field(bg_event, "y") << ", "
+                     << json_field(bg_event, "elevation") << ", "
+                     << json_field(bg_event, "item") << ", "
+                     << json_field(bg_event, "flag");
                 if (version == "firered") {
                     text << ", "
-                         << json_to_string(bg_event, "quantity") << ", "
-                         << json_to_string(bg_event, "underfoot");
+                         << json_field(bg_event, "quantity") << ", "
+                         << json_field(bg_event, "underfoot");
                 }
                 text << "\n";
             }
             else if (type == "secret_base") {
                 text << "\tbg_secret_base_event "
-                     << json_to_string(bg_event, "x") << ", "
-                     << json_to_string(bg_event, "y") << ", "
-                     << json_to_string(bg_event, "elevation") << ", "
-                     << json_to_string(bg_event, "secret_base_id") << "\n";
+                     << json_field(bg_event, "x") << ", "
+                     << json_field(bg_event, "y") << ", "
+                     << json_field(bg_event, "elevation") << ", "
+                     << json_field(bg_event, "secret_base_id") << "\n";
             } else {
                 FATAL_ERROR("Unknown bg event type '%s'. Expected 'sign', 'hidden_item', or 'secret_base'.\n", type.c_str());
             }
@@ -328,8 +418,6 @@ string generate_map_events_text(Json map_data) {
     text << mapName << "_MapEvents::\n"
          << "\tmap_events " << objects_label << ", " << warps_label << ", "
          << coords_label << ", " << bgs_label << "\n\n";
-
-    return text.str();
 }
 
 string strip_trailing_separator(string filename) {
@@ -347,6 +435,21 @@ string file_parent(string filename){
     return filename.substr(0, dir_pos + 1);
 }
 
+// out_dir ends with a path separator.
+void write_map_files(Emitter &text, const Json &map_data, const LayoutIndex &layouts, const string &out_dir) {
+    text.clear();
+    generate_map_header_text(text, map_data, layouts);
+    write_text_file(out_dir + "header.inc", text.str());
+
+    text.clear();
+    generate_map_events_text(text, map_data);
+    write_text_file(out_dir + "events.inc", text.str());
+
+    text.clear();
+    generate_map_connections_text(text, map_data);
+    write_text_file(out_dir + "connections.inc", text.str());
+}
+
 void process_map(string map_filepath, string layouts_filepath, string output_dir) {
     string mapdata_err, layouts_err;
 
@@ -361,107 +464,302 @@ void process_map(string map_filepath, string layouts_filepath, string output_dir
     if (layouts_data == Json())
         FATAL_ERROR("%s\n", layouts_err.c_str());
 
-    string header_text = generate_map_header_text(map_data, layouts_data);
-    string events_text = generate_map_events_text(map_data);
-    string connections_text = generate_map_connections_text(map_data);
+    Emitter text;
+    write_map_files(text, map_data, index_layouts(layouts_data), strip_trailing_separator(output_dir).append(sep));
+}
+
+vector<string> get_map_names(const Json &groups_data) {
+    vector<string> map_names;
+
+    for (const Json &group : groups_data["group_order"].array_items())
+    for (const Json &map_name : groups_data[json_to_string(group)].array_items())
+        map_names.push_back(json_to_string(map_name));
+
+    return map_names;
+}
+
+Json read_map(const string &maps_dir, const string &map_name) {
+    string map_filepath = maps_dir + map_name + sep + "map.json";
+    string err;
+
+    Json map_data = Json::parse(read_text_file(map_filepath), err);
+    if (map_data == Json())
+        FATAL_ERROR("%s: %s\n", map_filepath.c_str(), err.c_str());
+
+    return map_data;
+}
 
+// Runs worker on a thread per core, but on no more threads than there are items.
+void run_workers(size_t num_items, const std::function<void()> &worker) {
+    size_t thread_count = std::min<size_t>(std::max(1u, thread::hardware_concurrency()), num_items);
+    vector<thread> threads;
+
+    for (size_t i = 1; i < thread_count; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (thread &t : threads)
+        t.join();
+}
+
+// Generates the files of every map in map_groups.json from a pool of threads,
+// sharing one parse of layouts.json.
+void process_world(string groups_filepath, string layouts_filepath, string output_dir) {
+    string err;
+
+    Json groups_data = Json::parse(read_text_file(groups_filepath), err);
+    if (groups_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    Json layouts_data = Json::parse(read_text_file(layouts_filepath), err);
+    if (layouts_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    LayoutIndex layouts = index_layouts(layouts_data);
+    vector<string> map_names = get_map_names(groups_data);
+
+    string maps_dir = file_parent(groups_filepath);
     string out_dir = strip_trailing_separator(output_dir).append(sep);
-    write_text_file(out_dir + "header.inc", header_text);
-    write_text_file(out_dir + "events.inc", events_text);
-    write_text_file(out_dir + "connections.inc", connections_text);
+
+    atomic<size_t> next_map(0);
+    run_workers(map_names.size(), [&]() {
+        Emitter text;
+        size_t i;
+        while ((i = next_map++) < map_names.size())
+            write_map_files(text, read_map(maps_dir, map_names[i]), layouts, out_dir + map_names[i] + sep);
+    });
+}
+
+// Connection directions in the order of their CONNECTION_* constants, starting
+// from CONNECTION_SOUTH.
+const vector<string> connection_directions = { "down", "up", "left", "right", "dive", "emerge" };
+
+int connection_direction_rank(const Json &connection) {
+    string direction = json_to_string(connection, "direction");
+
+    auto found = find(connection_directions.begin(), connection_directions.end(), direction);
+    if (found == connection_directions.end())
+        FATAL_ERROR("Unknown connection direction '%s'.\n", direction.c_str());
+
+    return found - connection_directions.begin();
+}
+
+// A map's connections sorted by direction and then offset, with the size of
+// each connected map and the range of the shared edge it covers, from start
+// up to but not including end. connection_index holds the first connection
+// and the number of connections in each direction.
+Json generate_map_connections_graph(const Json &map_data, const Json &layout,
+                                    const unordered_map<string, const Json *> &maps_by_id, const LayoutIndex &layouts) {
+    vector<const Json *> connections;
+    for (const Json &connection : map_data["connections"].array_items())
+        connections.push_back(&connection);
+
+    stable_sort(connections.begin(), connections.end(), [](const Json *a, const Json *b) {
+        int rank_a = connection_direction_rank(*a), rank_b = connection_direction_rank(*b);
+        if (rank_a != rank_b)
+            return rank_a < rank_b;
+        return (*a)["offset"].int_value() < (*b)["offset"].int_value();
+    });
+
+    Json::array connections_graph;
+    vector<int> firsts(connection_directions.size(), 0), counts(connection_directions.size(), 0);
+
+    for (const Json *connection : connections) {
+        string connected_map = json_to_string(*connection, "map");
+
+        auto found = maps_by_id.find(connected_map);
+        if (found == maps_by_id.end())
+            FATAL_ERROR("Failed to find map %s connected to %s.\n", connected_map.c_str(), json_to_string(map_data, "id").c_str());
+
+        const Json &connected_layout = find_layout(*found->second, layouts);
+        int rank = connection_direction_rank(*connection);
+        int offset = (*connection)["offset"].int_value();
+        int width = connected_layout["width"].int_value();
+        int height = connected_layout["height"].int_value();
+
+        Json::object entry = {
+            { "direction", connection_directions[rank] },
+            { "map", connected_map },
+            { "offset", offset },
+            { "width", width },
+            { "height", height },
+        };
+
+        // Dive and emerge connections cover the whole map rather than an edge.
+        if (rank < 4) {
+            bool vertical = rank < 2;
+            int edge = vertical ? layout["width"].int_value() : layout["height"].int_value();
+            int connected_edge = vertical ? width : height;
+            entry["start"] = std::max(offset, 0);
+            entry["end"] = std::min(edge, connected_edge + offset);
+        }
+
+        if (counts[rank]++ == 0)
+            firsts[rank] = connections_graph.size();
+        connections_graph.push_back(entry);
+    }
+
+    Json::object connection_index;
+    for (size_t i = 0; i < connection_directions.size(); i++)
+        connection_index[connection_directions[i]] = Json::array { counts[i] ? firsts[i] : 0, counts[i] };
+
+    return Json::object {
+        { "connections", connections_graph },
+        { "connection_index", connection_index },
+    };
 }
 
-string generate_groups_text(Json groups_data) {
-    ostringstream text;
+// The connection and warp graph of every map, for tools that look at the world
+// as a whole. Each map is written on a line of its own.
+void process_graph(string groups_filepath, string layouts_filepath, string output_file) {
+    string err;
+
+    Json groups_data = Json::parse(read_text_file(groups_filepath), err);
+    if (groups_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    Json layouts_data = Json::parse(read_text_file(layouts_filepath), err);
+    if (layouts_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    LayoutIndex layouts = index_layouts(layouts_data);
+    vector<string> map_names = get_map_names(groups_data);
+    string maps_dir = file_parent(groups_filepath);
+
+    vector<Json> maps(map_names.size());
+    atomic<size_t> next_map(0);
+
+    run_workers(map_names.size(), [&]() {
+        size_t i;
+        while ((i = next_map++) < map_names.size())
+            maps[i] = read_map(maps_dir, map_names[i]);
+    });
 
+    unordered_map<string, const Json *> maps_by_name, maps_by_id;
+    for (const Json &map_data : maps) {
+        maps_by_name[json_to_string(map_data, "name")] = &map_data;
+        maps_by_id[json_to_string(map_data, "id")] = &map_data;
+    }
+
+    Emitter text;
+    text << "{\n\"maps\": [\n";
+
+    size_t map_index = 0;
+    int group_num = 0;
+    for (const Json &group : groups_data["group_order"].array_items()) {
+        int map_num = 0;
+        for (size_t n = groups_data[json_to_string(group)].array_items().size(); n > 0; n--, map_index++, map_num++) {
+            const Json &map_data = maps[map_index];
+            const Json &layout = find_layout(map_data, layouts);
+
+            // Maps that share another map's events share its warps too.
+            const Json *events_map = &map_data;
+            if (has_field(map_data, "shared_events_map")) {
+                auto found = maps_by_name.find(json_to_string(map_data, "shared_events_map"));
+                if (found == maps_by_name.end())
+                    FATAL_ERROR("Failed to find the shared events map of %s.\n", json_to_string(map_data, "name").c_str());
+                events_map = found->second;
+            }
+
+            Json::array warps;
+            for (const Json &warp : (*events_map)["warp_events"].array_items()) {
+                warps.push_back(Json::object {
+                    { "x", warp["x"] },
+                    { "y", warp["y"] },
+                    { "elevation", warp["elevation"] },
+                    { "dest_map", warp["dest_map"] },
+                    { "dest_warp_id", warp["dest_warp_id"] },
+                });
+            }
+
+            Json::object entry = generate_map_connections_graph(map_data, layout, maps_by_id, layouts).object_items();
+            entry["id"] = map_data["id"];
+            entry["name"] = map_data["name"];
+            entry["group"] = group_num;
+            entry["num"] = map_num;
+            entry["layout"] = layout["id"];
+            entry["width"] = layout["width"];
+            entry["height"] = layout["height"];
+            entry["warps"] = warps;
+
+            text << (map_index ? ",\n" : "") << Json(entry).dump();
+        }
+        group_num++;
+    }
+
+    text << "\n]\n}\n";
+
+    write_text_file(output_file, text.str());
+}
+
+void generate_groups_text(Emitter &text, const Json &groups_data) {
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/map_groups.json\n@\n\n";
 
-    for (auto &key : groups_data["group_order"].array_items()) {
+    for (const Json &key : groups_data["group_order"].array_items()) {
         string group = json_to_string(key);
         text << group << "::\n";
-        auto maps = groups_data[group].array_items();
-        for (Json &map_name : maps)
-            text << "\t.4byte " << json_to_string(map_name) << "\n";
+        for (const Json &map_name : groups_data[group].array_items())
+            text << "\t.4byte " << json_field(map_name) << "\n";
         text << "\n";
     }
 
     text << "\t.align 2\n" << "gMapGroups::\n";
-    for (auto &group : groups_data["group_order"].array_items())
-        text << "\t.4byte " << json_to_string(group) << "\n";
+    for (const Json &group : groups_data["group_order"].array_items())
+        text << "\t.4byte " << json_field(group) << "\n";
     text << "\n";
-
-    return text.str();
 }
 
-string generate_connections_text(Json groups_data, string include_path) {
-    vector<Json> map_names;
-
-    for (auto &group : groups_data["group_order"].array_items())
-    for (auto map_name : groups_data[json_to_string(group)].array_items())
-        map_names.push_back(map_name);
+// The order in which the connections of each map are included.
+vector<string> get_connections_include_order(const Json &groups_data) {
+    vector<string> map_names = get_map_names(groups_data);
 
-    vector<Json> connections_include_order = groups_data["connections_include_order"].array_items();
+    const Json::array &connections_include_order = groups_data["connections_include_order"].array_items();
 
-    if (connections_include_order.size() > 0)
-        sort(map_names.begin(), map_names.end(), [connections_include_order](const Json &a, const Json &b) {
-            auto iter_a = find(connections_include_order.begin(), connections_include_order.end(), a);
-            if (iter_a == connections_include_order.end())
-                iter_a = connections_include_order.begin() + numeric_limits<int>::max();
-            auto iter_b = find(connections_include_order.begin(), connections_include_order.end(), b);
-            if (iter_b == connections_include_order.end())
-                iter_b = connections_include_order.begin() + numeric_limits<int>::max();
-            return iter_a < iter_b;
-        });
+    if (connections_include_order.size() > 0) {
+        // Maps missing from the list go after the ones in it.
+        unordered_map<string, int> include_rank;
 
-    ostringstream text;
+        for (size_t i = 0; i < connections_include_order.size(); i++)
+            include_rank.emplace(connections_include_order[i].string_value(), i);
 
-    text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/map_groups.json\n@\n\n";
+        auto rank = [&include_rank](const string &map_name) {
+            auto found = include_rank.find(map_name);
+            return found != include_rank.end() ? found->second : numeric_limits<int>::max();
+        };
 
-    for (Json map_name : map_names)
-        text << "\t.include \"" << include_path << "/" <<  json_to_string(map_name) << "/connections.inc\"\n";
+        sort(map_names.begin(), map_names.end(), [&rank](const string &a, const string &b) {
+            return rank(a) < rank(b);
+        });
+    }
 
-    return text.str();
+    return map_names;
 }
 
-string generate_headers_text(Json groups_data, string include_path) {
-    vector<string> map_names;
+void generate_connections_text(Emitter &text, const Json &groups_data, const string &include_path) {
+    vector<string> map_names = get_connections_include_order(groups_data);
 
-    for (auto &group : groups_data["group_order"].array_items())
-    for (auto map_name : groups_data[json_to_string(group)].array_items())
-        map_names.push_back(json_to_string(map_name));
+    text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/map_groups.json\n@\n\n";
 
-    ostringstream text;
+    for (const string &map_name : map_names)
+        text << "\t.include \"" << include_path << "/" << map_name << "/connections.inc\"\n";
+}
 
+void generate_headers_text(Emitter &text, const Json &groups_data, const string &include_path) {
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/map_groups.json\n@\n\n";
 
-    for (string map_name : map_names)
+    for (const string &map_name : get_map_names(groups_data))
         text << "\t.include \"" << include_path << "/" << map_name << "/header.inc\"\n";
-
-    return text.str();
 }
 
-string generate_events_text(Json groups_data, string include_path) {
-    vector<string> map_names;
-
-    for (auto &group : groups_data["group_order"].array_items())
-    for (auto map_name : groups_data[json_to_string(group)].array_items())
-        map_names.push_back(json_to_string(map_name));
-
-    ostringstream text;
-
+void generate_events_text(Emitter &text, const Json &groups_data, const string &include_path) {
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from " << include_path << "/map_groups.json\n@\n\n";
 
-    for (string map_name : map_names)
+    for (const string &map_name : get_map_names(groups_data))
         text << "\t.include \"" << include_path << "/" << map_name << "/events.inc\"\n";
-
-    return text.str();
 }
 
-string generate_map_constants_text(string groups_filepath, Json groups_data) {
+void generate_map_constants_text(Emitter &text, string groups_filepath, const Json &groups_data) {
     string file_dir = file_parent(groups_filepath) + sep;
 
-    ostringstream text;
-
     text << "#ifndef GUARD_CONSTANTS_MAP_GROUPS_H\n"
          << "#define GUARD_CONSTANTS_MAP_GROUPS_H\n\n";
 
@@ -469,13 +767,13 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
 
     int group_num = 0;
 
-    for (auto &group : groups_data["group_order"].array_items()) {
+    for (const Json &group : groups_data["group_order"].array_items()) {
         string groupName = json_to_string(group);
         text << "// " << groupName << "\n";
         vector<string> map_ids;
         size_t max_length = 0;
 
-        for (auto &map_name : groups_data[groupName].array_items()) {
+        for (const Json &map_name : groups_data[groupName].array_items()) {
             string map_filepath = file_dir + json_to_string(map_name) + sep + "map.json";
             string err_str;
             Json map_data = Json::parse(read_text_file(map_filepath), err_str);
@@ -488,7 +786,7 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
         }
 
         int map_id_num = 0;
-        for (string map_id : map_ids) {
+        for (const string &map_id : map_ids) {
             text << "#define " << map_id << string((max_length - map_id.length() + 1), ' ')
                  << "(" << map_id_num++ << " | (" << group_num << " << 8))\n";
         }
@@ -499,8 +797,6 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
 
     text << "#define MAP_GROUPS_COUNT " << group_num << "\n\n";
     text << "#endif // GUARD_CONSTANTS_MAP_GROUPS_H\n";
-
-    return text.str();
 }
 
 // Output paths are directories with trailing path separators
@@ -514,87 +810,82 @@ void process_groups(string groups_filepath, string output_asm, string output_c)
     if (groups_data == Json())
         FATAL_ERROR("%s\n", err.c_str());
 
-    string groups_text = generate_groups_text(groups_data);
-    string connections_text = generate_connections_text(groups_data, output_asm);
-    string headers_text = generate_headers_text(groups_data, output_asm);
-    string events_text = generate_events_text(groups_data, output_asm);
-    string map_header_text = generate_map_constants_text(groups_filepath, groups_data);
+    Emitter text;
 
-    write_text_file(output_asm + sep + "groups.inc", groups_text);
-    write_text_file(output_asm + sep + "connections.inc", connections_text);
-    write_text_file(output_asm + sep + "headers.inc", headers_text);
-    write_text_file(output_asm + sep + "events.inc", events_text);
-    write_text_file(output_c + sep + "map_groups.h", map_header_text);
-}
+    generate_groups_text(text, groups_data);
+    write_text_file(output_asm + sep + "groups.inc", text.str());
+
+    text.clear();
+    generate_connections_text(text, groups_data, output_asm);
+    write_text_file(output_asm + sep + "connections.inc", text.str());
+
+    text.clear();
+    generate_headers_text(text, groups_data, output_asm);
+    write_text_file(output_asm + sep + "headers.inc", text.str());
 
-string generate_layout_headers_text(Json layouts_data) {
-    ostringstream text;
+    text.clear();
+    generate_events_text(text, groups_data, output_asm);
+    write_text_file(output_asm + sep + "events.inc", text.str());
+
+    text.clear();
+    generate_map_constants_text(text, groups_filepath, groups_data);
+    write_text_file(output_c + sep + "map_groups.h", text.str());
+}
 
+void generate_layout_headers_text(Emitter &text, const Json &layouts_data) {
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/layouts/layouts.json\n@\n\n";
 
-    for (auto &layout : layouts_data["layouts"].array_items()) {
+    for (const Json &layout : layouts_data["layouts"].array_items()) {
         if (layout == Json::object()) continue;
         string layoutName = json_to_string(layout, "name");
-        string border_label = layoutName + "_Border";
-        string blockdata_label = layoutName + "_Blockdata";
-        text << border_label << "::\n"
-             << "\t.incbin \"" << json_to_string(layout, "border_filepath") << "\"\n\n"
-             << blockdata_label << "::\n"
-             << "\t.incbin \"" << json_to_string(layout, "blockdata_filepath") << "\"\n\n"
+        text << layoutName << "_Border::\n"
+             << "\t.incbin \"" << json_field(layout, "border_filepath") << "\"\n\n"
+             << layoutName << "_Blockdata::\n"
+             << "\t.incbin \"" << json_field(layout, "blockdata_filepath") << "\"\n\n"
              << "\t.align 2\n"
              << layoutName << "::\n"
-             << "\t.4byte " << json_to_string(layout, "width") << "\n"
-             << "\t.4byte " << json_to_string(layout, "height") << "\n"
-             << "\t.4byte " << border_label << "\n"
-             << "\t.4byte " << blockdata_label << "\n"
-             << "\t.4byte " << json_to_string(layout, "primary_tileset") << "\n"
-             << "\t.4byte " << json_to_string(layout, "secondary_tileset") << "\n";
+             << "\t.4byte " << json_field(layout, "width") << "\n"
+             << "\t.4byte " << json_field(layout, "height") << "\n"
+             << "\t.4byte " << layoutName << "_Border\n"
+             << "\t.4byte " << layoutName << "_Blockdata\n"
+             << "\t.4byte " << json_field(layout, "primary_tileset") << "\n"
+             << "\t.4byte " << json_field(layout, "secondary_tileset") << "\n";
         if (version == "firered") {
-            text << "\t.byte " << json_to_string(layout, "border_width") << "\n"
-                 << "\t.byte " << json_to_string(layout, "border_height") << "\n"
+            text << "\t.byte " << json_field(layout, "border_width") << "\n"
+                 << "\t.byte " << json_field(layout, "border_height") << "\n"
                  << "\t.2byte 0\n";
         }
         text << "\n";
     }
-
-    return text.str();
 }
 
-string generate_layouts_table_text(Json layouts_data) {
-    ostringstream text;
-
+void generate_layouts_table_text(Emitter &text, const Json &layouts_data) {
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/layouts/layouts.json\n@\n\n";
 
     text << "\t.align 2\n"
-         << json_to_string(layouts_data, "layouts_table_label") << "::\n";
+         << json_field(layouts_data, "layouts_table_label") << "::\n";
 
-    for (auto &layout : layouts_data["layouts"].array_items()) {
+    for (const Json &layout : layouts_data["layouts"].array_items()) {
         string layout_name = json_to_string(layout, "name", true);
         if (layout_name.empty()) layout_name = "NULL";
         text << "\t.4byte " << layout_name << "\n";
     }
-
-    return text.str();
 }
 
-string generate_layouts_constants_text(Json layouts_data) {
-    ostringstream text;
-
+void generate_layouts_constants_text(Emitter &text, const Json &layouts_data) {
     text << "#ifndef GUARD_CONSTANTS_LAYOUTS_H\n"
          << "#define GUARD_CONSTANTS_LAYOUTS_H\n\n";
 
     text << "//\n// DO NOT MODIFY THIS FILE! It is auto-generated from data/layouts/layouts.json\n//\n\n";
 
     int i = 1;
-    for (auto &layout : layouts_data["layouts"].array_items()) {
+    for (const Json &layout : layouts_data["layouts"].array_items()) {
         if (layout != Json::object())
-            text << "#define " << json_to_string(layout, "id") << " " << i << "\n";
+            text << "#define " << json_field(layout, "id") << " " << i << "\n";
         i++;
     }
 
     text << "\n#endif // GUARD_CONSTANTS_LAYOUTS_H\n";
-
-    return text.str();
 }
 
 void process_layouts(string layouts_filepath, string output_asm, string output_c) {
@@ -607,13 +898,397 @@ void process_layouts(string layouts_filepath, string output_asm, string output_c
     if (layouts_data == Json())
         FATAL_ERROR("%s\n", err.c_str());
 
-    string layout_headers_text = generate_layout_headers_text(layouts_data);
-    string layouts_table_text = generate_layouts_table_text(layouts_data);
-    string layouts_constants_text = generate_layouts_constants_text(layouts_data);
+    Emitter text;
 
-    write_text_file(output_asm + "layouts.inc", layout_headers_text);
-    write_text_file(output_asm + "layouts_table.inc", layouts_table_text);
-    write_text_file(output_c + "layouts.h", layouts_constants_text);
+    generate_layout_headers_text(text, layouts_data);
+    write_text_file(output_asm + "layouts.inc", text.str());
+
+    text.clear();
+    generate_layouts_table_text(text, layouts_data);
+    write_text_file(output_asm + "layouts_table.inc", text.str());
+
+    text.clear();
+    generate_layouts_constants_text(text, layouts_data);
+    write_text_file(output_c + "layouts.h", text.str());
+}
+
+// Object output puts the data of the .inc files straight into the objects of
+// data/maps.s and data/map_events.s, without going through the assembler.
+// Each generator mirrors the text generator of the same data, and the macros
+// it uses from asm/macros/map.inc.
+
+bool is_symbol_name(const string &s) {
+    if (s.empty() || isdigit(static_cast<unsigned char>(s[0])))
+        return false;
+
+    for (char c : s) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '.' && c != '$')
+            return false;
+    }
+
+    return true;
+}
+
+// A .4byte that holds either a constant or a pointer to a symbol.
+void emit_pointer(ElfObject &obj, Constants &constants, const string &value) {
+    long long number;
+
+    if (constants.evaluate(value, number))
+        obj.word(number);
+    else if (is_symbol_name(value))
+        obj.word_symbol(value);
+    else
+        FATAL_ERROR("Failed to resolve '%s' to a constant or symbol.\n", value.c_str());
+}
+
+long long field_value(Constants &constants, const Json &data, const string &field) {
+    const Json &value = data[field];
+
+    // Numbers would be written out in decimal and read back unchanged.
+    if (value.is_number())
+        return value.int_value();
+    if (value.is_string() && !value.string_value().empty())
+        return constants.value(value.string_value());
+
+    return constants.value(json_to_string(data, field));
+}
+
+void generate_map_header_object(ElfObject &obj, Constants &constants, const Json &map_data, const LayoutIndex &layouts) {
+    const Json &layout = find_layout(map_data, layouts);
+
+    string mapName = json_to_string(map_data, "name");
+
+    obj.label(mapName, false);
+    obj.word_symbol(json_to_string(layout, "name"));
+
+    if (has_field(map_data, "shared_events_map"))
+        obj.word_symbol(json_to_string(map_data, "shared_events_map") + "_MapEvents");
+    else
+        obj.word_symbol(mapName + "_MapEvents");
+
+    if (has_field(map_data, "shared_scripts_map"))
+        obj.word_symbol(json_to_string(map_data, "shared_scripts_map") + "_MapScripts");
+    else
+        obj.word_symbol(mapName + "_MapScripts");
+
+    if (has_field(map_data, "connections")
+     && map_data["connections"].array_items().size() > 0 && json_to_string(map_data, "connections_no_include", true) != "TRUE")
+        obj.word_symbol(mapName + "_MapConnections");
+    else
+        obj.word(0);
+
+    obj.hword(field_value(constants, map_data, "music"));
+    obj.hword(field_value(constants, layout, "id"));
+    obj.byte(field_value(constants, map_data, "region_map_section"));
+    obj.byte(field_value(constants, map_data, "requires_flash"));
+    obj.byte(field_value(constants, map_data, "weather"));
+    obj.byte(field_value(constants, map_data, "map_type"));
+    obj.hword(0);
+
+    if (version == "ruby") {
+        obj.byte(field_value(constants, map_data, "show_map_name"));
+    } else {
+        // map_header_flags
+        obj.byte(((field_value(constants, map_data, "show_map_name") & 1) << 3)
+               | ((field_value(constants, map_data, "allow_running") & 1) << 2)
+               | ((field_value(constants, map_data, "allow_escaping") & 1) << 1)
+               | field_value(constants, map_data, "allow_cycling"));
+    }
+
+    obj.byte(field_value(constants, map_data, "battle_scene"));
+}
+
+void generate_map_connections_object(ElfObject &obj, Constants &constants, const Json &map_data) {
+    const Json &connections = map_data["connections"];
+
+    if (connections == Json())
+        return;
+
+    string mapName = json_to_string(map_data, "name");
+
+    obj.label(mapName + "_MapConnectionsList", false);
+
+    for (const Json &connection : connections.array_items()) {
+        long long map_id = field_value(constants, connection, "map");
+
+        obj.byte(constants.value("connection_" + json_to_string(connection, "direction")));
+        obj.space(3);
+        obj.word(field_value(constants, connection, "offset"));
+        obj.byte(map_id >> 8);
+        obj.byte(map_id & 0xFF);
+        obj.space(2);
+    }
+
+    obj.label(mapName + "_MapConnections", false);
+    obj.word(connections.array_items().size());
+    obj.word_symbol(mapName + "_MapConnectionsList");
+}
+
+// bg_event: arg7 is only used by hidden items.
+void emit_bg_event(ElfObject &obj, Constants &constants, const Json &bg_event, long long kind, const string &arg6, long long arg7) {
+    obj.hword(field_value(constants, bg_event, "x"));
+    obj.hword(field_value(constants, bg_event, "y"));
+    obj.byte(field_value(constants, bg_event, "elevation"));
+    obj.byte(kind);
+    obj.space(2);
+
+    if (kind != constants.value("BG_EVENT_HIDDEN_ITEM")) {
+        emit_pointer(obj, constants, arg6);
+    } else {
+        obj.hword(constants.value(arg6));
+        obj.hword(arg7);
+    }
+}
+
+void generate_map_events_object(ElfObject &obj, Constants &constants, const Json &map_data) {
+    if (has_field(map_data, "shared_events_map"))
+        return;
+
+    string mapName = json_to_string(map_data, "name");
+
+    obj.align(2);
+
+    string objects_label, warps_label, coords_label, bgs_label;
+
+    const Json::array &object_events = map_data["object_events"].array_items();
+
+    if (object_events.size() > 0) {
+        objects_label = mapName + "_ObjectEvents";
+        obj.label(objects_label, false);
+        for (unsigned int i = 0; i < object_events.size(); i++) {
+            const Json &obj_event = object_events[i];
+            string type = json_to_string(obj_event, "type", true);
+
+            if (type == "" || type == "object") {
+                obj.byte(i + 1);
+                obj.byte(field_value(constants, obj_event, "graphics_id"));
+                obj.byte(constants.value("OBJ_KIND_NORMAL"));
+                obj.space(1);
+                obj.hword(field_value(constants, obj_event, "x"));
+                obj.hword(field_value(constants, obj_event, "y"));
+                obj.byte(field_value(constants, obj_event, "elevation"));
+                obj.byte(field_value(constants, obj_event, "movement_type"));
+                obj.byte((field_value(constants, obj_event, "movement_range_y") << 4)
+                       | field_value(constants, obj_event, "movement_range_x"));
+                obj.space(1);
+                obj.hword(field_value(constants, obj_event, "trainer_type"));
+                obj.hword(field_value(constants, obj_event, "trainer_sight_or_berry_tree_id"));
+                emit_pointer(obj, constants, json_to_string(obj_event, "script"));
+                obj.hword(field_value(constants, obj_event, "flag"));
+                obj.space(2);
+            } else if (type == "clone") {
+                long long target_map_id = field_value(constants, obj_event, "target_map");
+
+                obj.byte(i + 1);
+                obj.byte(field_value(constants, obj_event, "graphics_id"));
+                obj.byte(constants.value("OBJ_KIND_CLONE"));
+                obj.space(1);
+                obj.hword(field_value(constants, obj_event, "x"));
+                obj.hword(field_value(constants, obj_event, "y"));
+                obj.byte(field_value(constants, obj_event, "target_local_id"));
+                obj.space(3);
+                obj.hword(target_map_id & 0xFF);
+                obj.hword(target_map_id >> 8);
+                obj.space(8);
+            } else {
+                FATAL_ERROR("Unknown object event type '%s'. Expected 'object' or 'clone'.\n", type.c_str());
+            }
+        }
+    } else {
+        objects_label = "NULL";
+    }
+
+    const Json::array &warp_events = map_data["warp_events"].array_items();
+
+    if (warp_events.size() > 0) {
+        warps_label = mapName + "_MapWarps";
+        obj.label(warps_label, false);
+        for (const Json &warp_event : warp_events) {
+            long long map_id = field_value(constants, warp_event, "dest_map");
+
+            obj.hword(field_value(constants, warp_event, "x"));
+            obj.hword(field_value(constants, warp_event, "y"));
+            obj.byte(field_value(constants, warp_event, "elevation"));
+            obj.byte(field_value(constants, warp_event, "dest_warp_id"));
+            obj.byte(map_id & 0xFF);
+            obj.byte(map_id >> 8);
+        }
+    } else {
+        warps_label = "NULL";
+    }
+
+    const Json::array &coord_events = map_data["coord_events"].array_items();
+
+    if (coord_events.size() > 0) {
+        coords_label = mapName + "_MapCoordEvents";
+        obj.label(coords_label, false);
+        for (const Json &coord_event : coord_events) {
+            string type = json_to_string(coord_event, "type");
+            bool weather = type == "weather";
+
+            if (type != "trigger" && !weather)
+                FATAL_ERROR("Unknown coord event type '%s'. Expected 'trigger' or 'weather'.\n", type.c_str());
+
+            obj.hword(field_value(constants, coord_event, "x"));
+            obj.hword(field_value(constants, coord_event, "y"));
+            obj.byte(field_value(constants, coord_event, "elevation"));
+            obj.space(1);
+            obj.hword(field_value(constants, coord_event, weather ? "weather" : "var"));
+            obj.hword(weather ? 0 : field_value(constants, coord_event, "var_value"));
+            obj.space(2);
+            emit_pointer(obj, constants, weather ? "NULL" : json_to_string(coord_event, "script"));
+        }
+    } else {
+        coords_label = "NULL";
+    }
+
+    const Json::array &bg_events = map_data["bg_events"].array_items();
+
+    if (bg_events.size() > 0) {
+        bgs_label = mapName + "_MapBGEvents";
+        obj.label(bgs_label, false);
+        for (const Json &bg_event : bg_events) {
+            string type = json_to_string(bg_event, "type");
+            if (type == "sign") {
+                emit_bg_event(obj, constants, bg_event, field_value(constants, bg_event, "player_facing_dir"),
+                              json_to_string(bg_event, "script"), 0);
+            }
+            else if (type == "hidden_item") {
+                emit_bg_event(obj, constants, bg_event, constants.value("BG_EVENT_HIDDEN_ITEM"), json_to_string(bg_event, "item"),
+                              field_value(constants, bg_event, "flag") - constants.value("FLAG_HIDDEN_ITEMS_START"));
+            }
+            else if (type == "secret_base") {
+                emit_bg_event(obj, constants, bg_event, constants.value("BG_EVENT_SECRET_BASE"),
+                              json_to_string(bg_event, "secret_base_id"), 0);
+            } else {
+                FATAL_ERROR("Unknown bg event type '%s'. Expected 'sign', 'hidden_item', or 'secret_base'.\n", type.c_str());
+            }
+        }
+    } else {
+        bgs_label = "NULL";
+    }
+
+    obj.label(mapName + "_MapEvents", true);
+    obj.byte(object_events.size());
+    obj.byte(warp_events.size());
+    obj.byte(coord_events.size());
+    obj.byte(bg_events.size());
+    emit_pointer(obj, constants, objects_label);
+    emit_pointer(obj, constants, warps_label);
+    emit_pointer(obj, constants, coords_label);
+    emit_pointer(obj, constants, bgs_label);
+}
+
+void generate_layouts_object(ElfObject &obj, Constants &constants, const Json &layouts_data) {
+    for (const Json &layout : layouts_data["layouts"].array_items()) {
+        if (layout == Json::object()) continue;
+        string layoutName = json_to_string(layout, "name");
+
+        obj.label(layoutName + "_Border", true);
+        obj.incbin(json_to_string(layout, "border_filepath"));
+        obj.label(layoutName + "_Blockdata", true);
+        obj.incbin(json_to_string(layout, "blockdata_filepath"));
+        obj.align(2);
+        obj.label(layoutName, true);
+        obj.word(field_value(constants, layout, "width"));
+        obj.word(field_value(constants, layout, "height"));
+        obj.word_symbol(layoutName + "_Border");
+        obj.word_symbol(layoutName + "_Blockdata");
+        emit_pointer(obj, constants, json_to_string(layout, "primary_tileset"));
+        emit_pointer(obj, constants, json_to_string(layout, "secondary_tileset"));
+    }
+
+    obj.align(2);
+    obj.label(json_to_string(layouts_data, "layouts_table_label"), true);
+
+    for (const Json &layout : layouts_data["layouts"].array_items()) {
+        string layout_name = json_to_string(layout, "name", true);
+        if (layout_name.empty()) layout_name = "NULL";
+        emit_pointer(obj, constants, layout_name);
+    }
+}
+
+void generate_groups_object(ElfObject &obj, Constants &constants, const Json &groups_data) {
+    for (const Json &key : groups_data["group_order"].array_items()) {
+        string group = json_to_string(key);
+        obj.label(group, true);
+        for (const Json &map_name : groups_data[group].array_items())
+            emit_pointer(obj, constants, json_to_string(map_name));
+    }
+
+    obj.align(2);
+    obj.label("gMapGroups", true);
+    for (const Json &group : groups_data["group_order"].array_items())
+        emit_pointer(obj, constants, json_to_string(group));
+}
+
+// Assembles the objects of data/maps.s, which holds the layouts, map headers,
+// groups and connections, and of data/map_events.s, parsing the maps once for
+// both. Each object has a definitions file giving the constants its data
+// refers to, like the includes of its .s file would.
+void process_objects(string groups_filepath, string layouts_filepath,
+                     string maps_output, string maps_definitions,
+                     string events_output, string events_definitions) {
+    if (version == "firered")
+        FATAL_ERROR("ERROR: Object output only supports the map data layout of emerald and ruby.\n");
+
+    string err;
+
+    Json groups_data = Json::parse(read_text_file(groups_filepath), err);
+    if (groups_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    Json layouts_data = Json::parse(read_text_file(layouts_filepath), err);
+    if (layouts_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    LayoutIndex layouts = index_layouts(layouts_data);
+    vector<string> map_names = get_map_names(groups_data);
+    string maps_dir = file_parent(groups_filepath);
+
+    vector<Json> maps(map_names.size());
+    atomic<size_t> next_map(0);
+
+    run_workers(map_names.size(), [&]() {
+        size_t i;
+        while ((i = next_map++) < map_names.size())
+            maps[i] = read_map(maps_dir, map_names[i]);
+    });
+
+    unordered_map<string, const Json *> maps_by_name;
+    for (size_t i = 0; i < map_names.size(); i++)
+        maps_by_name[map_names[i]] = &maps[i];
+
+    {
+        Constants constants;
+        constants.load(maps_definitions);
+
+        ElfObject obj;
+
+        generate_layouts_object(obj, constants, layouts_data);
+
+        for (const Json &map_data : maps)
+            generate_map_header_object(obj, constants, map_data, layouts);
+
+        generate_groups_object(obj, constants, groups_data);
+
+        for (const string &map_name : get_connections_include_order(groups_data))
+            generate_map_connections_object(obj, constants, *maps_by_name[map_name]);
+
+        obj.write(maps_output);
+    }
+
+    {
+        Constants constants;
+        constants.load(events_definitions);
+
+        ElfObject obj;
+
+        for (const Json &map_data : maps)
+            generate_map_events_object(obj, constants, map_data);
+
+        obj.write(events_output);
+    }
 }
 
 int main(int argc, char *argv[]) {
@@ -627,8 +1302,8 @@ int main(int argc, char *argv[]) {
 
     char *mode_arg = argv[1];
     string mode(mode_arg);
-    if (mode != "layouts" && mode != "map" && mode != "groups")
-        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', or 'groups'.\n");
+    if (mode != "layouts" && mode != "map" && mode != "groups" && mode != "world" && mode != "object" && mode != "graph")
+        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', 'groups', 'world', 'object', or 'graph'.\n");
 
     if (mode == "map") {
         if (argc != 6)
@@ -652,6 +1327,17 @@ int main(int argc, char *argv[]) {
 
         process_groups(filepath, output_asm, output_c);
     }
+    else if (mode == "world") {
+        if (argc != 6)
+            FATAL_ERROR("USAGE: mapjson world <game-version> <groups_file> <layouts_file> <output_dir>\n");
+
+        infer_separator(argv[3]);
+        string filepath(argv[3]);
+        string layouts_filepath(argv[4]);
+        string output_dir(argv[5]);
+
+        process_world(filepath, layouts_filepath, output_dir);
+    }
     else if (mode == "layouts") {
         if (argc != 6)
             FATAL_ERROR("USAGE: mapjson layouts <game-version> <layouts_file> <output_asm_dir> <output_c_dir>\n");
@@ -663,8 +1349,34 @@ int main(int argc, char *argv[]) {
 
         process_layouts(filepath, output_asm, output_c);
     }
+    else if (mode == "object") {
+        if (argc != 9)
+            FATAL_ERROR("USAGE: mapjson object <game-version> <groups_file> <layouts_file> <maps_output> <maps_definitions> <events_output> <events_definitions>\n");
+
+        infer_separator(argv[3]);
+        string filepath(argv[3]);
+        string layouts_filepath(argv[4]);
+        string maps_output(argv[5]);
+        string maps_definitions(argv[6]);
+        string events_output(argv[7]);
+        string events_definitions(argv[8]);
+
+        process_objects(filepath, layouts_filepath, maps_output, maps_definitions, events_output, events_definitions);
+        return 0;
+    }
+    else if (mode == "graph") {
+        if (argc != 6)
+            FATAL_ERROR("USAGE: mapjson graph <game-version> <groups_file> <layouts_file> <output_file>\n");
+
+        infer_separator(argv[3]);
+        string filepath(argv[3]);
+        string layouts_filepath(argv[4]);
+        string output_file(argv[5]);
+
+        process_graph(filepath, layouts_filepath, output_file);
+    }
     else {
-        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', or 'groups'.\n");
+        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', 'groups', 'world', 'object', or 'graph'.\n");
     }
 
     return 0;
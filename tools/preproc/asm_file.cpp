@@ -28,6 +28,7 @@
 #include "string_parser.h"
 #include "../../include/constants/characters.h"
 #include "io.h"
+#include "output.h"
 
 AsmFile::AsmFile(std::string filename, bool isStdin, bool doEnum) : m_filename(filename)
 {
@@ -491,7 +492,8 @@ void AsmFile::OutputLine()
         if (m_pos >= m_size)
         {
             RaiseWarning("file doesn't end with newline");
-            puts(&m_buffer[m_lineStart]);
+            g_output->Write(&m_buffer[m_lineStart], m_pos - m_lineStart);
+            g_output->Char('\n');
         }
         else
         {
@@ -500,10 +502,8 @@ void AsmFile::OutputLine()
     }
     else
     {
-        m_buffer[m_pos] = 0;
-        puts(&m_buffer[m_lineStart]);
-        m_buffer[m_pos] = '\n';
         m_pos++;
+        g_output->Write(&m_buffer[m_lineStart], m_pos - m_lineStart);
         m_lineStart = m_pos;
         m_lineNum++;
     }
@@ -549,7 +549,7 @@ bool AsmFile::ParseEnum()
         std::string currentIdentName = ReadIdentifier();
         if (!currentIdentName.empty())
         {
-            std::printf("# %ld \"%s\"\n", currentHeaderLine, headerFilename.c_str());
+            g_output->Printf("# %ld \"%s\"\n", currentHeaderLine, headerFilename.c_str());
             currentHeaderLine += SkipWhitespaceAndEol();
             if (m_buffer[m_pos] == '=')
             {
@@ -575,7 +575,7 @@ bool AsmFile::ParseEnum()
                 }
                 enumCounter = 0;
             }
-            std::printf(".equiv %s, (%s) + %ld\n", currentIdentName.c_str(), enumBase.c_str(), enumCounter);
+            g_output->Printf(".equiv %s, (%s) + %ld\n", currentIdentName.c_str(), enumBase.c_str(), enumCounter);
             enumCounter++;
             symbolCount++;
         }
@@ -641,7 +641,7 @@ bool AsmFile::IsAtEnd()
 // Output the current location to set gas's logical file and line numbers.
 void AsmFile::OutputLocation()
 {
-    std::printf("# %ld \"%s\"\n", m_lineNum, m_filename.c_str());
+    g_output->Printf("# %ld \"%s\"\n", m_lineNum, m_filename.c_str());
 }
 
 // Reports a diagnostic message.
@@ -666,7 +666,7 @@ do                                        \
 void AsmFile::RaiseError(const char* format, ...)
 {
     DO_REPORT("error");
-    std::exit(1);
+    ExitOnError();
 }
 
 // Reports a warning diagnostic.
@@ -51,6 +51,7 @@ public:
     void OutputLine();
     void OutputLocation();
     bool ParseEnum();
+    const std::string& GetFilename() const { return m_filename; }
 
 private:
     char* m_buffer;
@@ -0,0 +1,222 @@
+#include "preproc.h"
+#include "batch.h"
+#include "output.h"
+#include "io.h"
+#include "include_cache.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BatchJob
+{
+    std::string input;
+    std::string output;
+    long size;
+    double milliseconds;
+    std::atomic<bool> started;
+    std::atomic<bool> finished;
+};
+
+// The jobs are fixed up front and independent of each other, so the workers
+// simply claim the next unstarted one from a shared index; the biggest files
+// go first so that no worker is left with a large one at the end.
+static std::vector<BatchJob *> s_jobs;
+static std::atomic<std::size_t> s_nextJob;
+
+// Set once a job has failed, so that the workers stop claiming new ones.
+static std::atomic<bool> s_failed;
+
+// Thrown by ExitOnError on a worker thread. Exiting from there would run the
+// exit handlers while other workers are still writing their outputs.
+struct JobFailure
+{
+};
+
+static thread_local bool s_isWorker;
+
+void ExitOnError()
+{
+    if (s_isWorker)
+        throw JobFailure();
+
+    std::exit(1);
+}
+
+static void ReadManifest(const char *manifestPath)
+{
+    long size;
+    char *buffer = ReadFileToBuffer(manifestPath, false, &size);
+    long pos = 0;
+    long lineNum = 1;
+
+    while (pos < size)
+    {
+        std::vector<std::string> fields;
+
+        while (pos < size && buffer[pos] != '\n')
+        {
+            if (buffer[pos] == '#')
+            {
+                while (pos < size && buffer[pos] != '\n')
+                    pos++;
+                break;
+            }
+
+            if (buffer[pos] == ' ' || buffer[pos] == '\t' || buffer[pos] == '\r')
+            {
+                pos++;
+                continue;
+            }
+
+            long start = pos;
+
+            while (pos < size && buffer[pos] != ' ' && buffer[pos] != '\t' && buffer[pos] != '\r' && buffer[pos] != '\n')
+                pos++;
+
+            fields.push_back(std::string(&buffer[start], pos - start));
+        }
+
+        if (fields.size() == 2)
+        {
+            BatchJob *job = new BatchJob;
+            job->input = fields[0];
+            job->output = fields[1];
+            job->milliseconds = 0;
+            job->started = false;
+            job->finished = false;
+
+            if (!GetFileSize(job->input, job->size))
+                FATAL_ERROR("%s:%ld: Failed to open \"%s\" for reading.\n", manifestPath, lineNum, job->input.c_str());
+
+            s_jobs.push_back(job);
+        }
+        else if (fields.size() != 0)
+        {
+            FATAL_ERROR("%s:%ld: expected an input and an output path\n", manifestPath, lineNum);
+        }
+
+        pos++;
+        lineNum++;
+    }
+
+    delete[] buffer;
+
+    std::stable_sort(s_jobs.begin(), s_jobs.end(), [](const BatchJob *a, const BatchJob *b) { return a->size > b->size; });
+}
+
+// Removes the outputs of failed jobs, and of those that another failure
+// stopped, so that they don't look up to date to make.
+static void RemoveUnfinishedOutputs()
+{
+    for (BatchJob *job : s_jobs)
+        if (job->started && !job->finished)
+            std::remove(job->output.c_str());
+}
+
+static void RunJob(BatchJob *job, bool doEnum, bool incbinAsm)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    job->started = true;
+
+    std::FILE *fp = std::fopen(job->output.c_str(), "wb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", job->output.c_str());
+
+    g_output = new Output(fp);
+
+    try
+    {
+        PreprocFile(job->input.c_str(), false, doEnum, incbinAsm);
+    }
+    catch (const JobFailure&)
+    {
+        // The output is removed anyway, so what's left in g_output is dropped.
+        g_output = NULL;
+        std::fclose(fp);
+        throw;
+    }
+
+    delete g_output;
+    g_output = NULL;
+
+    if (std::fclose(fp) != 0)
+        FATAL_ERROR("Failed to write \"%s\". (error: %s)\n", job->output.c_str(), std::strerror(errno));
+
+    job->finished = true;
+    job->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void RunJobs(bool doEnum, bool incbinAsm)
+{
+    s_isWorker = true;
+
+    while (!s_failed)
+    {
+        std::size_t index = s_nextJob++;
+
+        if (index >= s_jobs.size())
+            break;
+
+        try
+        {
+            RunJob(s_jobs[index], doEnum, incbinAsm);
+        }
+        catch (const JobFailure&)
+        {
+            s_failed = true;
+        }
+    }
+
+    s_isWorker = false;
+}
+
+void RunBatch(const char *manifestPath, bool doEnum, bool incbinAsm, int jobCount, bool reportTimings)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    ReadManifest(manifestPath);
+    g_includeCache = new IncludeCache;
+
+    if (jobCount <= 0)
+        jobCount = std::max(1u, std::thread::hardware_concurrency());
+
+    jobCount = std::min<std::size_t>(jobCount, std::max<std::size_t>(s_jobs.size(), 1));
+
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < jobCount; i++)
+        workers.emplace_back(RunJobs, doEnum, incbinAsm);
+
+    RunJobs(doEnum, incbinAsm);
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    if (s_failed)
+    {
+        RemoveUnfinishedOutputs();
+        std::exit(1);
+    }
+
+    if (reportTimings)
+    {
+        std::vector<const BatchJob *> jobs(s_jobs.begin(), s_jobs.end());
+
+        std::stable_sort(jobs.begin(), jobs.end(), [](const BatchJob *a, const BatchJob *b) { return a->milliseconds > b->milliseconds; });
+
+        for (const BatchJob *job : jobs)
+            std::printf("%10.2f ms  %s\n", job->milliseconds, job->input.c_str());
+
+        double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%10.2f ms  total (%zu files, %d jobs)\n", total, jobs.size(), jobCount);
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+// Preprocesses every (input, output) pair listed in a manifest file, one pair
+// per line, on jobCount threads sharing the already loaded g_charmap.
+// If reportTimings is set, prints how long each file took once all are done.
+void RunBatch(const char *manifestPath, bool doEnum, bool incbinAsm, int jobCount, bool reportTimings);
+
+#endif // BATCH_H_
@@ -31,8 +31,10 @@
 #include "utf8.h"
 #include "string_parser.h"
 #include "io.h"
+#include "output.h"
+#include "incbin.h"
 
-CFile::CFile(const char * filenameCStr, bool isStdin)
+CFile::CFile(const char * filenameCStr, bool isStdin, bool incbinAsm)
 {
     if (isStdin)
         m_filename = std::string{"<stdin>/"}.append(filenameCStr);
@@ -44,6 +46,8 @@ CFile::CFile(const char * filenameCStr, bool isStdin)
     m_pos = 0;
     m_lineNum = 1;
     m_isStdin = isStdin;
+    m_incbinAsm = incbinAsm;
+    m_braceDepth = 0;
 }
 
 CFile::CFile(CFile&& other) : m_filename(std::move(other.m_filename))
@@ -53,6 +57,8 @@ CFile::CFile(CFile&& other) : m_filename(std::move(other.m_filename))
     m_size = other.m_size;
     m_lineNum = other.m_lineNum;
     m_isStdin = other.m_isStdin;
+    m_incbinAsm = other.m_incbinAsm;
+    m_braceDepth = other.m_braceDepth;
 
     other.m_buffer = NULL;
 }
@@ -72,26 +78,29 @@ void CFile::Preproc()
         {
             if (m_buffer[m_pos] == stringChar)
             {
-                std::putchar(stringChar);
+                g_output->Char(stringChar);
                 m_pos++;
                 stringChar = 0;
             }
             else if (m_buffer[m_pos] == '\\' && m_buffer[m_pos + 1] == stringChar)
             {
-                std::putchar('\\');
-                std::putchar(stringChar);
+                g_output->Char('\\');
+                g_output->Char(stringChar);
                 m_pos += 2;
             }
             else
             {
                 if (m_buffer[m_pos] == '\n')
                     m_lineNum++;
-                std::putchar(m_buffer[m_pos]);
+                g_output->Char(m_buffer[m_pos]);
                 m_pos++;
             }
         }
         else
         {
+            if (m_incbinAsm && m_braceDepth == 0 && (m_pos == 0 || m_buffer[m_pos - 1] == '\n'))
+                TryConvertIncbinDefinition();
+
             TryConvertString();
             TryConvertIncbin();
 
@@ -100,7 +109,7 @@ void CFile::Preproc()
 
             char c = m_buffer[m_pos++];
 
-            std::putchar(c);
+            g_output->Char(c);
 
             if (c == '\n')
                 m_lineNum++;
@@ -108,6 +117,10 @@ void CFile::Preproc()
                 stringChar = '"';
             else if (c == '\'')
                 stringChar = '\'';
+            else if (c == '{')
+                m_braceDepth++;
+            else if (c == '}')
+                m_braceDepth--;
         }
     }
 }
@@ -129,7 +142,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos += 2;
         m_lineNum++;
-        std::putchar('\n');
+        g_output->Char('\n');
         return true;
     }
 
@@ -137,7 +150,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos++;
         m_lineNum++;
-        std::putchar('\n');
+        g_output->Char('\n');
         return true;
     }
 
@@ -180,7 +193,7 @@ void CFile::TryConvertString()
 
     SkipWhitespace();
 
-    std::printf("{ ");
+    g_output->Write("{ ");
 
     while (1)
     {
@@ -202,7 +215,10 @@ void CFile::TryConvertString()
             }
 
             for (int i = 0; i < length; i++)
-                printf("0x%02X, ", s[i]);
+            {
+                g_output->HexByte(s[i]);
+                g_output->Write(", ", 2);
+            }
         }
         else if (m_buffer[m_pos] == ')')
         {
@@ -221,9 +237,9 @@ void CFile::TryConvertString()
     }
 
     if (noTerminator)
-        std::printf(" }");
+        g_output->Write(" }");
     else
-        std::printf("0xFF }");
+        g_output->Write("0xFF }");
 }
 
 bool CFile::CheckIdentifier(const std::string& ident)
@@ -237,53 +253,14 @@ bool CFile::CheckIdentifier(const std::string& ident)
     return (i == ident.length());
 }
 
-std::unique_ptr<unsigned char[]> CFile::ReadWholeFile(const std::string& path, int& size)
-{
-    FILE* fp = std::fopen(path.c_str(), "rb");
-
-    if (fp == nullptr)
-        RaiseError("Failed to open \"%s\" for reading.\n", path.c_str());
-
-    std::fseek(fp, 0, SEEK_END);
-
-    size = std::ftell(fp);
-
-    std::unique_ptr<unsigned char[]> buffer = std::unique_ptr<unsigned char[]>(new unsigned char[size]);
-
-    std::rewind(fp);
-
-    if (std::fread(buffer.get(), size, 1, fp) != 1)
-        RaiseError("Failed to read \"%s\".\n", path.c_str());
-
-    std::fclose(fp);
-
-    return buffer;
-}
-
-int ExtractData(const std::unique_ptr<unsigned char[]>& buffer, int offset, int size)
-{
-    switch (size)
-    {
-    case 1:
-        return buffer[offset];
-    case 2:
-        return (buffer[offset + 1] << 8)
-            | buffer[offset];
-    case 4:
-        return (buffer[offset + 3] << 24)
-            | (buffer[offset + 2] << 16)
-            | (buffer[offset + 1] << 8)
-            | buffer[offset];
-    default:
-        FATAL_ERROR("Invalid size passed to ExtractData.\n");
-    }
-}
-
 void CFile::TryConvertIncbin()
 {
-    std::string idents[6] = { "INCBIN_S8", "INCBIN_U8", "INCBIN_S16", "INCBIN_U16", "INCBIN_S32", "INCBIN_U32" };
+    static const std::string idents[6] = { "INCBIN_S8", "INCBIN_U8", "INCBIN_S16", "INCBIN_U16", "INCBIN_S32", "INCBIN_U32" };
     int incbinType = -1;
 
+    if (m_buffer[m_pos] != 'I')
+        return;
+
     for (int i = 0; i < 6; i++)
     {
         if (CheckIdentifier(idents[i]))
@@ -315,7 +292,7 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("{");
+    g_output->Char('{');
 
     while (true)
     {
@@ -351,25 +328,15 @@ void CFile::TryConvertIncbin()
 
         m_pos++;
 
-        int fileSize;
-        std::unique_ptr<unsigned char[]> buffer = ReadWholeFile(path, fileSize);
+        MappedFile file;
 
-        if ((fileSize % size) != 0)
-            RaiseError("Size %d doesn't evenly divide file size %d.\n", size, fileSize);
+        if (!file.Open(path))
+            RaiseError("Failed to open \"%s\" for reading.\n", path.c_str());
 
-        int count = fileSize / size;
-        int offset = 0;
+        if ((file.Size() % size) != 0)
+            RaiseError("Size %d doesn't evenly divide file size %ld.\n", size, file.Size());
 
-        for (int i = 0; i < count; i++)
-        {
-            int data = ExtractData(buffer, offset, size);
-            offset += size;
-
-            if (isSigned)
-                std::printf("%d,", data);
-            else
-                std::printf("%uu,", data);
-        }
+        WriteIncbinData(file.Data(), file.Size(), size, isSigned);
 
         SkipWhitespace();
 
@@ -384,7 +351,267 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("}");
+    g_output->Char('}');
+}
+
+static long SkipSpace(const char *buffer, long pos)
+{
+    while (buffer[pos] == ' ' || buffer[pos] == '\t' || buffer[pos] == '\n' || buffer[pos] == '\r')
+        pos++;
+
+    return pos;
+}
+
+static bool MatchAt(const char *buffer, long pos, const char *s)
+{
+    return std::strncmp(&buffer[pos], s, std::strlen(s)) == 0;
+}
+
+// Returns whether only whitespace and line markers separate the current
+// position from the previous top-level ';' or '}', or the start of the file.
+bool CFile::IsAtStatementStart()
+{
+    long pos = m_pos - 1;
+
+    for (;;)
+    {
+        while (pos >= 0 && (m_buffer[pos] == ' ' || m_buffer[pos] == '\t' || m_buffer[pos] == '\n' || m_buffer[pos] == '\r'))
+            pos--;
+
+        if (pos < 0)
+            return true;
+
+        long lineStart = pos;
+
+        while (lineStart > 0 && m_buffer[lineStart - 1] != '\n')
+            lineStart--;
+
+        while (m_buffer[lineStart] == ' ' || m_buffer[lineStart] == '\t')
+            lineStart++;
+
+        if (m_buffer[lineStart] != '#')
+            return m_buffer[pos] == ';' || m_buffer[pos] == '}';
+
+        pos = lineStart - 1;
+    }
+}
+
+// Reads "__attribute__((aligned(N)))" at pos. Any other attribute, such as a
+// section, would have to be mirrored in the asm, so those aren't accepted.
+bool CFile::ReadIncbinAttribute(long& pos, std::string& text, int& alignment)
+{
+    long start = pos;
+
+    if (!MatchAt(m_buffer, pos, "__attribute__"))
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + 13);
+
+    if (!MatchAt(m_buffer, pos, "(("))
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + 2);
+
+    if (MatchAt(m_buffer, pos, "aligned"))
+        pos += 7;
+    else if (MatchAt(m_buffer, pos, "__aligned__"))
+        pos += 11;
+    else
+        return false;
+
+    pos = SkipSpace(m_buffer, pos);
+
+    if (m_buffer[pos] != '(')
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + 1);
+
+    if (!IsAsciiDigit(m_buffer[pos]))
+        return false;
+
+    int value = 0;
+
+    while (IsAsciiDigit(m_buffer[pos]) && value < 0x10000)
+        value = value * 10 + (m_buffer[pos++] - '0');
+
+    pos = SkipSpace(m_buffer, pos);
+
+    if (m_buffer[pos] != ')')
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + 1);
+
+    if (!MatchAt(m_buffer, pos, "))"))
+        return false;
+
+    pos += 2;
+
+    if (value > alignment)
+        alignment = value;
+
+    text.append(1, ' ').append(&m_buffer[start], pos - start);
+
+    return true;
+}
+
+// With -a, replaces a top-level definition such as
+//     const u16 gPalette[] = INCBIN_U16("palette.gbapal");
+// with an extern declaration of the same type and size, plus an inline asm
+// block that pulls the file in with .incbin, so that cc1 never has to parse
+// the data as text. Anything that doesn't have exactly this shape is left to
+// TryConvertIncbin. That includes static definitions: cc1 drops unused static
+// data, but it can't drop an asm block.
+bool CFile::TryConvertIncbinDefinition()
+{
+    static const std::string idents[6] = { "INCBIN_S8", "INCBIN_U8", "INCBIN_S16", "INCBIN_U16", "INCBIN_S32", "INCBIN_U32" };
+    static const std::string types[6] = { "s8", "u8", "s16", "u16", "s32", "u32" };
+    long pos = m_pos;
+    bool isConst = false;
+    int alignment = 4;
+    std::string specifiers;
+    std::string attributes;
+    std::string type;
+    std::string name;
+
+    for (;;)
+    {
+        pos = SkipSpace(m_buffer, pos);
+
+        if (MatchAt(m_buffer, pos, "__attribute__"))
+        {
+            if (!ReadIncbinAttribute(pos, attributes, alignment))
+                return false;
+            continue;
+        }
+
+        if (!IsIdentifierStartingChar(m_buffer[pos]))
+            return false;
+
+        long start = pos;
+
+        while (IsIdentifierChar(m_buffer[pos]))
+            pos++;
+
+        std::string ident(&m_buffer[start], pos - start);
+
+        if (m_buffer[SkipSpace(m_buffer, pos)] == '[')
+        {
+            name = ident;
+            pos = SkipSpace(m_buffer, pos) + 1;
+            break;
+        }
+
+        if (ident == "static")
+            return false;
+
+        if (ident == "const")
+            isConst = true;
+        else if (ident != "volatile")
+            type = ident;
+
+        specifiers += ident;
+        specifiers += ' ';
+    }
+
+    // Only const data goes in .rodata, and only an unsized array is exactly as big as the file.
+    pos = SkipSpace(m_buffer, pos);
+
+    if (!isConst || m_buffer[pos] != ']')
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + 1);
+
+    while (MatchAt(m_buffer, pos, "__attribute__"))
+    {
+        if (!ReadIncbinAttribute(pos, attributes, alignment))
+            return false;
+        pos = SkipSpace(m_buffer, pos);
+    }
+
+    if (m_buffer[pos] != '=')
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + 1);
+
+    // The element type must match the INCBIN width, or the values would be truncated or widened.
+    int incbinType = -1;
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (MatchAt(m_buffer, pos, idents[i].c_str()) && type == types[i])
+        {
+            incbinType = i;
+            break;
+        }
+    }
+
+    if (incbinType == -1)
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + idents[incbinType].length());
+
+    if (m_buffer[pos] != '(')
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + 1);
+
+    if (m_buffer[pos] != '"')
+        return false;
+
+    long pathStart = ++pos;
+
+    while (m_buffer[pos] != '"')
+    {
+        char c = m_buffer[pos++];
+
+        if (c == 0 || c == '\r' || c == '\n' || c == '\\')
+            return false;
+    }
+
+    std::string path(&m_buffer[pathStart], pos - pathStart);
+
+    pos = SkipSpace(m_buffer, pos + 1);
+
+    if (m_buffer[pos] != ')')
+        return false;
+
+    pos = SkipSpace(m_buffer, pos + 1);
+
+    if (m_buffer[pos] != ';')
+        return false;
+
+    pos++;
+
+    if (!IsAtStatementStart())
+        return false;
+
+    int size = 1 << (incbinType / 2);
+    long fileSize;
+
+    if (!GetFileSize(path, fileSize))
+        RaiseError("Failed to open \"%s\" for reading.\n", path.c_str());
+
+    if ((fileSize % size) != 0)
+        RaiseError("Size %d doesn't evenly divide file size %ld.\n", size, fileSize);
+
+    const char *n = name.c_str();
+
+    g_output->Printf("extern %s%s[%ld]%s; ", specifiers.c_str(), n, fileSize / size, attributes.c_str());
+    g_output->Printf("asm(\".section .rodata\\n\\t.balign %d\\n\\t.global %s\\n", alignment, n);
+    g_output->Printf("%s:\\n\\t.incbin \\\"%s\\\"\\n\\t.size %s, %ld\\n\\t.type %s, %%object\\n\\t.previous\");",
+        n, path.c_str(), n, fileSize, n);
+
+    // Keep the line numbers in sync with the input.
+    for (; m_pos < pos; m_pos++)
+    {
+        if (m_buffer[m_pos] == '\n')
+        {
+            g_output->Char('\n');
+            m_lineNum++;
+        }
+    }
+
+    return true;
 }
 
 // Reports a diagnostic message.
@@ -409,7 +636,7 @@ do                                        \
 void CFile::RaiseError(const char* format, ...)
 {
     DO_REPORT("error");
-    std::exit(1);
+    ExitOnError();
 }
 
 // Reports a warning diagnostic.
@@ -30,7 +30,7 @@
 class CFile
 {
 public:
-    CFile(const char * filenameCStr, bool isStdin);
+    CFile(const char * filenameCStr, bool isStdin, bool incbinAsm);
     CFile(CFile&& other);
     CFile(const CFile&) = delete;
     ~CFile();
@@ -43,14 +43,18 @@ private:
     long m_lineNum;
     std::string m_filename;
     bool m_isStdin;
+    bool m_incbinAsm;
+    int m_braceDepth;
 
     bool ConsumeHorizontalWhitespace();
     bool ConsumeNewline();
     void SkipWhitespace();
     void TryConvertString();
-    std::unique_ptr<unsigned char[]> ReadWholeFile(const std::string& path, int& size);
     bool CheckIdentifier(const std::string& ident);
     void TryConvertIncbin();
+    bool TryConvertIncbinDefinition();
+    bool IsAtStatementStart();
+    bool ReadIncbinAttribute(long& pos, std::string& text, int& alignment);
     void ReportDiagnostic(const char* type, const char* format, std::va_list args);
     void RaiseError(const char* format, ...);
     void RaiseWarning(const char* format, ...);
@@ -378,7 +378,7 @@ Charmap::Charmap(std::string filename)
         Lhs lhs = reader.ReadLhs();
 
         if (lhs.type == LhsType::None)
-            return;
+            break;
 
         reader.ExpectEqualsSign();
 
@@ -405,4 +405,88 @@ Charmap::Charmap(std::string filename)
 
         reader.ExpectEmptyRestOfLine();
     }
+
+    CompileLookups();
+}
+
+void Charmap::CompileLookups()
+{
+    m_charTrie.assign(256, 0);
+
+    char key[4];
+
+    for (const auto& entry : m_chars)
+    {
+        std::int32_t code = entry.first;
+
+        // String literals can only have these chars escaped, and they can't
+        // contain control chars at all.
+        if (code == '"' || code == '\\')
+        {
+            key[0] = '\\';
+            key[1] = code;
+            AddCharKey(key, 2, entry.second);
+        }
+        else if (!IsAscii(code) || IsAsciiPrintable(code))
+        {
+            AddCharKey(key, EncodeUtf8(code, key), entry.second);
+        }
+    }
+
+    for (int code = 0; code < 128; code++)
+    {
+        if (m_escapes[code].length() != 0 && IsAsciiPrintable(code))
+        {
+            key[0] = '\\';
+            key[1] = code;
+            AddCharKey(key, 2, m_escapes[code]);
+        }
+    }
+
+    // Keep the table at most a quarter full so probe sequences stay short.
+    std::size_t tableSize = 16;
+
+    while (tableSize < m_constants.size() * 4)
+        tableSize *= 2;
+
+    m_constantTable.assign(tableSize, ConstantSlot{ NULL, NULL });
+    m_constantMask = tableSize - 1;
+
+    for (const auto& entry : m_constants)
+    {
+        std::uint32_t hash = kHashBasis;
+
+        for (unsigned char c : entry.first)
+            hash = (hash ^ c) * kHashPrime;
+
+        std::uint32_t slot = hash & m_constantMask;
+
+        while (m_constantTable[slot].key != NULL)
+            slot = (slot + 1) & m_constantMask;
+
+        m_constantTable[slot] = ConstantSlot{ &entry.first, &entry.second };
+    }
+}
+
+// UTF-8 is prefix-free and every escape is two bytes long, so a key can never
+// be a prefix of another.
+void Charmap::AddCharKey(const char* key, int keyLength, const std::string& sequence)
+{
+    std::int32_t node = 0;
+
+    for (int i = 0; i < keyLength - 1; i++)
+    {
+        std::int32_t slot = node * 256 + static_cast<unsigned char>(key[i]);
+
+        if (m_charTrie[slot] == 0)
+        {
+            m_charTrie[slot] = m_charTrie.size() / 256;
+            m_charTrie.resize(m_charTrie.size() + 256, 0);
+        }
+
+        node = m_charTrie[slot];
+    }
+
+    m_charTrie[node * 256 + static_cast<unsigned char>(key[keyLength - 1])] = ~static_cast<std::int32_t>(m_sequences.size());
+    m_sequences.push_back(&sequence);
 }
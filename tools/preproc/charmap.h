@@ -22,9 +22,11 @@
 #define CHARMAP_H
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <map>
 #include <vector>
+#include "char_util.h"
 
 class Charmap
 {
@@ -55,10 +57,85 @@ public:
 
         return it->second;
     }
+
+    // Matches the UTF-8 char or escape sequence at the start of s, as it would
+    // appear in a string literal. Returns its mapping and sets length to the
+    // number of bytes matched, or returns NULL if there's no mapping for it.
+    const std::string* MatchChar(const char* s, int& length) const
+    {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+        std::int32_t node = 0;
+
+        for (;;)
+        {
+            std::int32_t next = m_charTrie[node * 256 + *p++];
+
+            if (next == 0)
+                return NULL;
+
+            if (next < 0)
+            {
+                length = p - reinterpret_cast<const unsigned char*>(s);
+                return m_sequences[~next];
+            }
+
+            node = next;
+        }
+    }
+
+    // Matches the identifier at the start of s against the charmap constants.
+    // Returns its mapping and sets length to the length of the identifier,
+    // or returns NULL if it isn't a known constant.
+    const std::string* MatchConstant(const char* s, int& length) const
+    {
+        std::uint32_t hash = kHashBasis;
+        int i = 0;
+
+        while (IsIdentifierChar(s[i]))
+            hash = (hash ^ static_cast<unsigned char>(s[i++])) * kHashPrime;
+
+        for (std::uint32_t slot = hash & m_constantMask; m_constantTable[slot].key != NULL; slot = (slot + 1) & m_constantMask)
+        {
+            const ConstantSlot& entry = m_constantTable[slot];
+
+            if (entry.key->length() == static_cast<std::size_t>(i) && std::memcmp(entry.key->data(), s, i) == 0)
+            {
+                length = i;
+                return entry.sequence;
+            }
+        }
+
+        return NULL;
+    }
 private:
+    // FNV-1a
+    static const std::uint32_t kHashBasis = 2166136261u;
+    static const std::uint32_t kHashPrime = 16777619u;
+
+    struct ConstantSlot
+    {
+        const std::string* key;
+        const std::string* sequence;
+    };
+
     std::map<std::int32_t, std::string> m_chars;
     std::string m_escapes[128];
     std::map<std::string, std::string> m_constants;
+
+    // The chars and escapes compiled into a byte-level trie over their UTF-8
+    // spelling, so strings can be encoded without decoding each char first.
+    // Each node has 256 links, which are the index of the next node, the
+    // complement of an index into m_sequences, or 0 if nothing matches.
+    std::vector<const std::string*> m_sequences;
+    std::vector<std::int32_t> m_charTrie;
+
+    // The constants in an open-addressed hash table, so they can be matched
+    // without copying the name into a std::string first.
+    std::vector<ConstantSlot> m_constantTable;
+    std::uint32_t m_constantMask;
+
+    void CompileLookups();
+    void AddCharKey(const char* key, int keyLength, const std::string& sequence);
 };
 
 #endif // CHARMAP_H
@@ -0,0 +1,63 @@
+#include "preproc.h"
+#include "incbin.h"
+#include "output.h"
+#include <cstdint>
+#include <cstdio>
+
+static std::int32_t ReadValue(const unsigned char *data, int width)
+{
+    switch (width)
+    {
+    case 1:
+        return data[0];
+    case 2:
+        return (data[1] << 8) | data[0];
+    default:
+        return (static_cast<std::uint32_t>(data[3]) << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
+    }
+}
+
+// The text for every byte value, e.g. "255u," or "255,", so 8-bit data can be
+// rendered with one table lookup per element.
+struct ByteTable
+{
+    char text[256][6];
+    unsigned char length[256];
+
+    ByteTable(bool isSigned)
+    {
+        for (int i = 0; i < 256; i++)
+            length[i] = std::snprintf(text[i], sizeof(text[i]), isSigned ? "%d," : "%du,", i);
+    }
+};
+
+void WriteIncbinData(const unsigned char *data, long size, int width, bool isSigned)
+{
+    if (width == 1)
+    {
+        static const ByteTable signedTable(true);
+        static const ByteTable unsignedTable(false);
+        const ByteTable& table = isSigned ? signedTable : unsignedTable;
+
+        for (long i = 0; i < size; i++)
+            g_output->Write(table.text[data[i]], table.length[data[i]]);
+
+        return;
+    }
+
+    for (long offset = 0; offset < size; offset += width)
+    {
+        std::int32_t value = ReadValue(&data[offset], width);
+
+        if (isSigned)
+        {
+            g_output->Decimal(value);
+            g_output->Char(',');
+        }
+        else
+        {
+            g_output->Unsigned(static_cast<std::uint32_t>(value));
+            g_output->Write("u,", 2);
+        }
+    }
+}
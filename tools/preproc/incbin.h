@@ -0,0 +1,8 @@
+#ifndef INCBIN_H_
+#define INCBIN_H_
+
+// Writes the contents of an INCBIN file as comma-terminated integers of the
+// given width in bytes, e.g. "1u,2u,3u," for unsigned and "1,2,3," for signed data.
+void WriteIncbinData(const unsigned char *data, long size, int width, bool isSigned);
+
+#endif // INCBIN_H_
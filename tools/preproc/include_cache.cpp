@@ -0,0 +1,35 @@
+#include "include_cache.h"
+
+IncludeCache* g_includeCache;
+
+static std::string MakeKey(const std::string& path, bool doEnum)
+{
+    // -e changes the output, so the same file is cached separately with it.
+    return std::string(doEnum ? "e:" : "-:") + path;
+}
+
+bool IncludeCache::CheckSeen(const std::string& path, bool doEnum)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return !m_entries.insert(std::make_pair(MakeKey(path, doEnum), nullptr)).second;
+}
+
+std::shared_ptr<const std::string> IncludeCache::Find(const std::string& path, bool doEnum)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(MakeKey(path, doEnum));
+
+    if (it == m_entries.end())
+        return nullptr;
+
+    return it->second;
+}
+
+void IncludeCache::Insert(const std::string& path, bool doEnum, std::string output)
+{
+    std::shared_ptr<const std::string> shared = std::make_shared<const std::string>(std::move(output));
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_entries[MakeKey(path, doEnum)] = shared;
+}
@@ -0,0 +1,34 @@
+#ifndef INCLUDE_CACHE_H_
+#define INCLUDE_CACHE_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Keeps the preprocessed output of asm include files, so that an include
+// shared by many sources (asm/macros.inc, constants/constants.inc, ...) is
+// only tokenized and has its strings encoded once per process. Entries are
+// keyed by path: files aren't expected to change while a batch runs.
+//
+// An include's output is only captured the second time it's seen, so files
+// that are included just once don't pay for the extra copy.
+class IncludeCache
+{
+public:
+    // Returns whether the include was seen before, and notes that it has been.
+    bool CheckSeen(const std::string& path, bool doEnum);
+
+    std::shared_ptr<const std::string> Find(const std::string& path, bool doEnum);
+    void Insert(const std::string& path, bool doEnum, std::string output);
+
+private:
+    std::mutex m_mutex;
+    // A null output means the include was seen, but its output isn't kept yet.
+    std::unordered_map<std::string, std::shared_ptr<const std::string>> m_entries;
+};
+
+// Only set up in batch mode, where there is more than one source to share with.
+extern IncludeCache* g_includeCache;
+
+#endif // INCLUDE_CACHE_H_
@@ -49,3 +49,117 @@ char *ReadFileToBuffer(const char *filename, bool isStdin, long *size)
     std::fclose(fp);
     return buffer;
 }
+
+#include <sys/stat.h>
+
+bool GetFileSize(const std::string& path, long& size)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+    size = st.st_size;
+    return true;
+}
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Most INCBIN files are a few KB, where read() beats the cost of setting up
+// and tearing down a mapping, so only larger files get mapped.
+static const long kMinMappedSize = 64 * 1024;
+
+static bool ReadAll(int fd, unsigned char *data, long size)
+{
+    while (size > 0)
+    {
+        ssize_t count = read(fd, data, size);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+
+        data += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool ok = (fstat(fd, &st) == 0);
+
+    if (ok)
+    {
+        m_size = st.st_size;
+
+        if (m_size >= kMinMappedSize)
+        {
+            void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            ok = (data != MAP_FAILED);
+
+            if (ok)
+            {
+                m_data = static_cast<unsigned char *>(data);
+                m_isMapped = true;
+            }
+        }
+        else
+        {
+            m_data = new unsigned char[m_size > 0 ? m_size : 1];
+            ok = ReadAll(fd, m_data, m_size);
+        }
+    }
+
+    close(fd);
+    return ok;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_isMapped)
+        munmap(m_data, m_size);
+    else
+        delete[] m_data;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path)
+{
+    FILE *fp = std::fopen(path.c_str(), "rb");
+
+    if (fp == NULL)
+        return false;
+
+    std::fseek(fp, 0, SEEK_END);
+    m_size = std::ftell(fp);
+    std::rewind(fp);
+
+    m_data = new unsigned char[m_size > 0 ? m_size : 1];
+
+    bool ok = (m_size == 0 || std::fread(m_data, m_size, 1, fp) == 1);
+
+    std::fclose(fp);
+    return ok;
+}
+
+MappedFile::~MappedFile()
+{
+    delete[] m_data;
+}
+
+#endif // _WIN32
@@ -1,8 +1,28 @@
 #ifndef IO_H_
 #define IO_H_
 
+#include <string>
+
 #define CHUNK_SIZE 4096
 
 char *ReadFileToBuffer(const char *filename, bool isStdin, long *size);
+bool GetFileSize(const std::string& path, long& size);
+
+// Read-only view of a whole file, memory-mapped where the platform allows it.
+class MappedFile
+{
+public:
+    MappedFile() : m_data(nullptr), m_size(0), m_isMapped(false) {}
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile();
+    bool Open(const std::string& path);
+    const unsigned char *Data() const { return m_data; }
+    long Size() const { return m_size; }
+
+private:
+    unsigned char *m_data;
+    long m_size;
+    bool m_isMapped;
+};
 
 #endif // IO_H_
@@ -0,0 +1,119 @@
+#include "preproc.h"
+#include "output.h"
+#include <cstdarg>
+#include <cerrno>
+#include <cstring>
+
+Output::Output(std::FILE *fp) : m_fp(fp), m_sink(nullptr), m_length(0)
+{
+    m_buffer = new char[kCapacity];
+}
+
+// Collects the output in a string instead of writing it out.
+Output::Output(std::string *sink) : m_fp(nullptr), m_sink(sink), m_length(0)
+{
+    m_buffer = new char[kCapacity];
+}
+
+Output::~Output()
+{
+    Flush();
+    delete[] m_buffer;
+}
+
+// "00" through "99", so numbers can be converted two digits at a time.
+static const char s_digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+void Output::Unsigned(unsigned long value)
+{
+    char digits[20];
+    int start = sizeof(digits);
+
+    while (value >= 100)
+    {
+        unsigned int pair = (value % 100) * 2;
+        value /= 100;
+        digits[--start] = s_digitPairs[pair + 1];
+        digits[--start] = s_digitPairs[pair];
+    }
+
+    if (value >= 10)
+    {
+        digits[--start] = s_digitPairs[value * 2 + 1];
+        digits[--start] = s_digitPairs[value * 2];
+    }
+    else
+    {
+        digits[--start] = '0' + value;
+    }
+
+    Write(&digits[start], sizeof(digits) - start);
+}
+
+void Output::Decimal(long value)
+{
+    if (value < 0)
+    {
+        Char('-');
+        Unsigned(0UL - static_cast<unsigned long>(value));
+    }
+    else
+    {
+        Unsigned(value);
+    }
+}
+
+void Output::Printf(const char *format, ...)
+{
+    const int bufferSize = 1024;
+    char buffer[bufferSize];
+
+    std::va_list args, argsCopy;
+    va_start(args, format);
+    va_copy(argsCopy, args);
+    int length = std::vsnprintf(buffer, bufferSize, format, args);
+    va_end(args);
+
+    if (length < 0)
+        FATAL_ERROR("Failed to format output.\n");
+
+    if (length < bufferSize)
+    {
+        Write(buffer, length);
+    }
+    else
+    {
+        std::string longBuffer(length + 1, '\0');
+        std::vsnprintf(&longBuffer[0], length + 1, format, argsCopy);
+        Write(longBuffer.data(), length);
+    }
+
+    va_end(argsCopy);
+}
+
+void Output::Flush()
+{
+    if (m_length == 0)
+        return;
+
+    WriteDirect(m_buffer, m_length);
+    m_length = 0;
+}
+
+void Output::WriteDirect(const char *s, std::size_t length)
+{
+    if (m_sink != nullptr)
+        m_sink->append(s, length);
+    else if (std::fwrite(s, 1, length, m_fp) != length)
+        FATAL_ERROR("Failed to write output. (error: %s)\n", std::strerror(errno));
+}
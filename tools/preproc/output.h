@@ -0,0 +1,92 @@
+#ifndef OUTPUT_H_
+#define OUTPUT_H_
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Collects preprocessed output in one large buffer and writes it out with a
+// single fwrite whenever the buffer fills up, instead of going through stdio
+// one character at a time.
+class Output
+{
+public:
+    Output(std::FILE *fp);
+    Output(std::string *sink);
+    Output(const Output&) = delete;
+    ~Output();
+
+    void Char(char c)
+    {
+        if (m_length == kCapacity)
+            Flush();
+        m_buffer[m_length++] = c;
+    }
+
+    void Write(const char *s, std::size_t length)
+    {
+        if (m_length + length > kCapacity)
+        {
+            Flush();
+
+            if (length > kCapacity)
+            {
+                WriteDirect(s, length);
+                return;
+            }
+        }
+
+        std::memcpy(&m_buffer[m_length], s, length);
+        m_length += length;
+    }
+
+    void Write(const char *s)
+    {
+        Write(s, std::strlen(s));
+    }
+
+    void Write(const std::string& s)
+    {
+        Write(s.data(), s.length());
+    }
+
+    // Writes "0xXX", like printf("0x%02X").
+    void HexByte(unsigned char value)
+    {
+        static const char digits[] = "0123456789ABCDEF";
+
+        Reserve(4);
+        m_buffer[m_length++] = '0';
+        m_buffer[m_length++] = 'x';
+        m_buffer[m_length++] = digits[value >> 4];
+        m_buffer[m_length++] = digits[value & 0xF];
+    }
+
+    // Like printf("%d") and printf("%u").
+    void Decimal(long value);
+    void Unsigned(unsigned long value);
+
+    void Printf(const char *format, ...);
+    void Flush();
+
+private:
+    static const std::size_t kCapacity = 1 << 20;
+
+    std::FILE *m_fp;
+    std::string *m_sink;
+    char *m_buffer;
+    std::size_t m_length;
+
+    void Reserve(std::size_t length)
+    {
+        if (m_length + length > kCapacity)
+            Flush();
+    }
+
+    void WriteDirect(const char *s, std::size_t length);
+};
+
+// Each batch worker thread writes to its own output file.
+extern thread_local Output* g_output;
+
+#endif // OUTPUT_H_
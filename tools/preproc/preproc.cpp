@@ -25,40 +25,66 @@
 #include "asm_file.h"
 #include "c_file.h"
 #include "charmap.h"
+#include "batch.h"
+#include "output.h"
+#include "include_cache.h"
 
 static void UsageAndExit(const char *program);
 
 Charmap* g_charmap;
+thread_local Output* g_output;
 
 void PrintAsmBytes(unsigned char *s, int length)
 {
     if (length > 0)
     {
-        std::printf("\t.byte ");
+        g_output->Write("\t.byte ");
         for (int i = 0; i < length; i++)
         {
-            std::printf("0x%02X", s[i]);
+            g_output->HexByte(s[i]);
 
             if (i < length - 1)
-                std::printf(", ");
+                g_output->Write(", ", 2);
         }
-        std::putchar('\n');
+        g_output->Char('\n');
     }
 }
 
+// The output of an include that is being collected for g_includeCache.
+struct IncludeCapture
+{
+    std::size_t depth;
+    Output *parentOutput;
+    std::string output;
+};
+
 void PreprocAsmFile(std::string filename, bool isStdin, bool doEnum)
 {
     std::stack<AsmFile> stack;
+    std::stack<IncludeCapture> captures;
 
     stack.push(AsmFile(filename, isStdin, doEnum));
-    std::printf("# 1 \"%s\"\n", filename.c_str());
+    g_output->Printf("# 1 \"%s\"\n", filename.c_str());
 
     for (;;)
     {
         while (stack.top().IsAtEnd())
         {
+            std::string includePath = stack.top().GetFilename();
+
             stack.pop();
 
+            if (!captures.empty() && captures.top().depth == stack.size())
+            {
+                IncludeCapture& capture = captures.top();
+
+                delete g_output;
+                g_output = capture.parentOutput;
+                g_output->Write(capture.output);
+                g_includeCache->Insert(includePath, doEnum, std::move(capture.output));
+                captures.pop();
+            }
+
             if (stack.empty())
                 return;
             else
@@ -70,9 +96,28 @@ void PreprocAsmFile(std::string filename, bool isStdin, bool doEnum)
         switch (directive)
         {
         case Directive::Include:
-            stack.push(AsmFile(stack.top().ReadPath(), false, doEnum));
+        {
+            AsmFile include(stack.top().ReadPath(), false, doEnum);
+
+            if (g_includeCache != nullptr && g_includeCache->CheckSeen(include.GetFilename(), doEnum))
+            {
+                std::shared_ptr<const std::string> output = g_includeCache->Find(include.GetFilename(), doEnum);
+
+                if (output)
+                {
+                    g_output->Write(*output);
+                    stack.top().OutputLocation();
+                    break;
+                }
+
+                captures.push(IncludeCapture{ stack.size(), g_output, std::string() });
+                g_output = new Output(&captures.top().output);
+            }
+
+            stack.push(std::move(include));
             stack.top().OutputLocation();
             break;
+        }
         case Directive::String:
         {
             unsigned char s[kMaxStringLength];
@@ -99,8 +144,10 @@ void PreprocAsmFile(std::string filename, bool isStdin, bool doEnum)
 
             if (globalLabel.length() != 0)
             {
-                const char *s = globalLabel.c_str();
-                std::printf("%s: ; .global %s\n", s, s);
+                g_output->Write(globalLabel);
+                g_output->Write(": ; .global ");
+                g_output->Write(globalLabel);
+                g_output->Char('\n');
             }
             else
             {
@@ -113,9 +160,9 @@ void PreprocAsmFile(std::string filename, bool isStdin, bool doEnum)
     }
 }
 
-void PreprocCFile(const char * filename, bool isStdin)
+void PreprocCFile(const char * filename, bool isStdin, bool incbinAsm)
 {
-    CFile cFile(filename, isStdin);
+    CFile cFile(filename, isStdin, incbinAsm);
     cFile.Preproc();
 }
 
@@ -140,9 +187,45 @@ const char* GetFileExtension(const char* filename)
     return extension;
 }
 
+void PreprocFile(const char *source, bool isStdin, bool doEnum, bool incbinAsm)
+{
+    const char* extension = GetFileExtension(source);
+
+    if (!extension)
+        FATAL_ERROR("\"%s\" has no file extension.\n", source);
+
+    if ((extension[0] == 's') && extension[1] == 0)
+    {
+        if (incbinAsm)
+            FATAL_ERROR("-a is invalid for asm sources\n");
+        PreprocAsmFile(source, isStdin, doEnum);
+    }
+    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
+    {
+        if (doEnum)
+            FATAL_ERROR("-e is invalid for C sources\n");
+        PreprocCFile(source, isStdin, incbinAsm);
+    }
+    else
+    {
+        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", source, extension);
+    }
+
+    g_output->Flush();
+}
+
 static void UsageAndExit(const char *program)
 {
-    std::fprintf(stderr, "Usage: %s [-i] [-e] SRC_FILE CHARMAP_FILE\nwhere -i denotes if input is from stdin\n      -e enables enum handling\n", program);
+    std::fprintf(stderr,
+        "Usage: %s [-i] [-e] [-a] SRC_FILE CHARMAP_FILE\n"
+        "       %s [-e] [-a] [-j JOBS] [-t] -b MANIFEST CHARMAP_FILE\n"
+        "where -i denotes if input is from stdin\n"
+        "      -e enables enum handling\n"
+        "      -a turns top-level INCBIN definitions in C sources into .incbin directives\n"
+        "      -b preprocesses each \"SRC_FILE OUT_FILE\" line of MANIFEST\n"
+        "      -j sets the number of threads for -b (default: one per core)\n"
+        "      -t prints how long each file of -b took\n",
+        program, program);
     std::exit(EXIT_FAILURE);
 }
 
@@ -151,11 +234,16 @@ int main(int argc, char **argv)
     int opt;
     const char *source = NULL;
     const char *charmap = NULL;
+    const char *manifest = NULL;
+    int jobCount = 0;
+    bool reportTimings = false;
     bool isStdin = false;
     bool doEnum = false;
+    bool incbinAsm = false;
 
-    /* preproc [-i] [-e] SRC_FILE CHARMAP_FILE */
-    while ((opt = getopt(argc, argv, "ie")) != -1)
+    /* preproc [-i] [-e] [-a] SRC_FILE CHARMAP_FILE */
+    /* preproc [-e] [-a] [-j JOBS] [-t] -b MANIFEST CHARMAP_FILE */
+    while ((opt = getopt(argc, argv, "ieab:j:t")) != -1)
     {
         switch (opt)
         {
@@ -165,12 +253,36 @@ int main(int argc, char **argv)
         case 'e':
             doEnum = true;
             break;
+        case 'a':
+            incbinAsm = true;
+            break;
+        case 'b':
+            manifest = optarg;
+            break;
+        case 'j':
+            jobCount = std::atoi(optarg);
+            if (jobCount <= 0)
+                UsageAndExit(argv[0]);
+            break;
+        case 't':
+            reportTimings = true;
+            break;
         default:
             UsageAndExit(argv[0]);
             break;
         }
     }
 
+    if (manifest)
+    {
+        if (optind + 1 != argc || isStdin)
+            UsageAndExit(argv[0]);
+
+        g_charmap = new Charmap(argv[optind]);
+        RunBatch(manifest, doEnum, incbinAsm, jobCount, reportTimings);
+        return 0;
+    }
+
     if (optind + 2 != argc)
         UsageAndExit(argv[0]);
 
@@ -178,26 +290,9 @@ int main(int argc, char **argv)
     charmap = argv[optind + 1];
 
     g_charmap = new Charmap(charmap);
+    g_output = new Output(stdout);
 
-    const char* extension = GetFileExtension(source);
-
-    if (!extension)
-        FATAL_ERROR("\"%s\" has no file extension.\n", argv[1]);
-
-    if ((extension[0] == 's') && extension[1] == 0)
-    {
-        PreprocAsmFile(source, isStdin, doEnum);
-    }
-    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
-    {
-        if (doEnum)
-            FATAL_ERROR("-e is invalid for C sources\n");
-        PreprocCFile(source, isStdin);
-    }
-    else
-    {
-        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", argv[1], extension);
-    }
+    PreprocFile(source, isStdin, doEnum, incbinAsm);
 
     return 0;
 }
@@ -25,13 +25,17 @@
 #include <cstdlib>
 #include "charmap.h"
 
+// Ends the program after an error has been reported. A batch worker unwinds
+// its job instead, so that the process exits only once every worker is done.
+[[noreturn]] void ExitOnError();
+
 #ifdef _MSC_VER
 
 #define FATAL_ERROR(format, ...)               \
 do                                             \
 {                                              \
     std::fprintf(stderr, format, __VA_ARGS__); \
-    std::exit(1);                              \
+    ExitOnError();                             \
 } while (0)
 
 #else
@@ -40,7 +44,7 @@ do                                             \
 do                                               \
 {                                                \
     std::fprintf(stderr, format, ##__VA_ARGS__); \
-    std::exit(1);                                \
+    ExitOnError();                               \
 } while (0)
 
 #endif // _MSC_VER
@@ -51,4 +55,6 @@ const unsigned long kMaxCharmapSequenceLength = 16;
 
 extern Charmap* g_charmap;
 
+void PreprocFile(const char *source, bool isStdin, bool doEnum, bool incbinAsm);
+
 #endif // PREPROC_H
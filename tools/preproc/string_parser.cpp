@@ -20,6 +20,7 @@
 
 #include <cstdio>
 #include <cstdarg>
+#include <cstring>
 #include <stdexcept>
 #include "preproc.h"
 #include "string_parser.h"
@@ -27,8 +28,20 @@
 #include "utf8.h"
 
 // Reads a charmap char or escape sequence.
-std::string StringParser::ReadCharOrEscape()
+void StringParser::ReadCharOrEscape()
 {
+    int length;
+    const std::string* match = g_charmap->MatchChar(&m_buffer[m_pos], length);
+
+    if (match != NULL)
+    {
+        m_pos += length;
+        AppendSequence(*match);
+        return;
+    }
+
+    // Anything in the charmap was matched above, so this is an error unless
+    // the char has an unusual encoding. Work out which error to report.
     std::string sequence;
 
     bool isEscape = (m_buffer[m_pos] == '\\');
@@ -44,7 +57,8 @@ std::string StringParser::ReadCharOrEscape()
             if (sequence.length() == 0)
                 RaiseError("no mapping exists for double quote");
 
-            return sequence;
+            AppendSequence(sequence);
+            return;
         }
         else if (m_buffer[m_pos] == '\\')
         {
@@ -53,7 +67,8 @@ std::string StringParser::ReadCharOrEscape()
             if (sequence.length() == 0)
                 RaiseError("no mapping exists for backslash");
 
-            return sequence;
+            AppendSequence(sequence);
+            return;
         }
     }
 
@@ -90,14 +105,12 @@ std::string StringParser::ReadCharOrEscape()
             RaiseError("unknown character U+%X", code);
     }
 
-    return sequence;
+    AppendSequence(sequence);
 }
 
 // Reads a charmap constant, i.e. "{FOO}".
-std::string StringParser::ReadBracketedConstants()
+void StringParser::ReadBracketedConstants()
 {
-    std::string totalSequence;
-
     m_pos++; // Assume we're on the left curly bracket.
 
     while (m_buffer[m_pos] != '}')
@@ -106,22 +119,22 @@ std::string StringParser::ReadBracketedConstants()
 
         if (IsIdentifierStartingChar(m_buffer[m_pos]))
         {
-            long startPos = m_pos;
-
-            m_pos++;
+            int length;
+            const std::string* sequence = g_charmap->MatchConstant(&m_buffer[m_pos], length);
 
-            while (IsIdentifierChar(m_buffer[m_pos]))
-                m_pos++;
+            if (sequence == NULL || sequence->length() == 0)
+            {
+                long startPos = m_pos;
 
-            std::string sequence = g_charmap->Constant(std::string(&m_buffer[startPos], m_pos - startPos));
+                while (IsIdentifierChar(m_buffer[m_pos]))
+                    m_pos++;
 
-            if (sequence.length() == 0)
-            {
                 m_buffer[m_pos] = 0;
                 RaiseError("unknown constant '%s'", &m_buffer[startPos]);
             }
 
-            totalSequence += sequence;
+            m_pos += length;
+            AppendSequence(*sequence);
         }
         else if (IsAsciiDigit(m_buffer[m_pos]))
         {
@@ -130,17 +143,17 @@ std::string StringParser::ReadBracketedConstants()
             switch (integer.size)
             {
             case 1:
-                totalSequence += (unsigned char)integer.value;
+                AppendByte(integer.value);
                 break;
             case 2:
-                totalSequence += (unsigned char)integer.value;
-                totalSequence += (unsigned char)(integer.value >> 8);
+                AppendByte(integer.value);
+                AppendByte(integer.value >> 8);
                 break;
             case 4:
-                totalSequence += (unsigned char)integer.value;
-                totalSequence += (unsigned char)(integer.value >> 8);
-                totalSequence += (unsigned char)(integer.value >> 16);
-                totalSequence += (unsigned char)(integer.value >> 24);
+                AppendByte(integer.value);
+                AppendByte(integer.value >> 8);
+                AppendByte(integer.value >> 16);
+                AppendByte(integer.value >> 24);
                 break;
             }
         }
@@ -161,8 +174,6 @@ std::string StringParser::ReadBracketedConstants()
     }
 
     m_pos++; // Go past the right curly bracket.
-
-    return totalSequence;
 }
 
 // Reads a charmap string.
@@ -177,26 +188,41 @@ int StringParser::ParseString(long srcPos, unsigned char* dest, int& destLength)
 
     m_pos++;
 
-    destLength = 0;
+    m_dest = dest;
+    m_destLength = 0;
 
     while (m_buffer[m_pos] != '"')
     {
-        std::string sequence = (m_buffer[m_pos] == '{') ? ReadBracketedConstants() : ReadCharOrEscape();
-
-        for (const char& c : sequence)
-        {
-            if (destLength == kMaxStringLength)
-                RaiseError("mapped string longer than %d bytes", kMaxStringLength);
-
-            dest[destLength++] = c;
-        }
+        if (m_buffer[m_pos] == '{')
+            ReadBracketedConstants();
+        else
+            ReadCharOrEscape();
     }
 
     m_pos++; // Go past the right quote.
 
+    destLength = m_destLength;
+
     return m_pos - start;
 }
 
+void StringParser::AppendSequence(const std::string& sequence)
+{
+    if (m_destLength + (long)sequence.length() > kMaxStringLength)
+        RaiseError("mapped string longer than %d bytes", kMaxStringLength);
+
+    std::memcpy(&m_dest[m_destLength], sequence.data(), sequence.length());
+    m_destLength += sequence.length();
+}
+
+void StringParser::AppendByte(unsigned char c)
+{
+    if (m_destLength == kMaxStringLength)
+        RaiseError("mapped string longer than %d bytes", kMaxStringLength);
+
+    m_dest[m_destLength++] = c;
+}
+
 void StringParser::RaiseError(const char* format, ...)
 {
     const int bufferSize = 1024;
@@ -90,3 +90,35 @@ UnicodeChar DecodeUtf8(const char* s)
 
     return unicodeChar;
 }
+
+// Encodes Unicode code point "code" as UTF-8 into "s", which must have room
+// for 4 bytes. Returns the length of the encoding.
+int EncodeUtf8(std::int32_t code, char* s)
+{
+    if (code < 0x80)
+    {
+        s[0] = code;
+        return 1;
+    }
+
+    if (code < 0x800)
+    {
+        s[0] = 0xC0 | (code >> 6);
+        s[1] = 0x80 | (code & 0x3F);
+        return 2;
+    }
+
+    if (code < 0x10000)
+    {
+        s[0] = 0xE0 | (code >> 12);
+        s[1] = 0x80 | ((code >> 6) & 0x3F);
+        s[2] = 0x80 | (code & 0x3F);
+        return 3;
+    }
+
+    s[0] = 0xF0 | (code >> 18);
+    s[1] = 0x80 | ((code >> 12) & 0x3F);
+    s[2] = 0x80 | ((code >> 6) & 0x3F);
+    s[3] = 0x80 | (code & 0x3F);
+    return 4;
+}
@@ -30,5 +30,6 @@ struct UnicodeChar
 };
 
 UnicodeChar DecodeUtf8(const char* s);
+int EncodeUtf8(std::int32_t code, char* s);
 
 #endif // UTF8_H
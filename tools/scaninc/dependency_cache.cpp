@@ -0,0 +1,256 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/stat.h>
+#include "scaninc.h"
+#include "source_file.h"
+#include "dependency_cache.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+// The cache file is plain text. After the header line, each entry is a line
+// of tab-separated fields (path, number of dependencies, size, mtime, scan
+// time, hash), followed by one line per dependency: "I\t" and the include
+// or "B\t" and the incbin.
+static const char *const kCacheHeader = "scaninc dependency cache 1";
+
+static bool ReadFile(const std::string& path, std::string& contents)
+{
+    FILE *fp = std::fopen(path.c_str(), "rb");
+
+    if (fp == NULL)
+        return false;
+
+    char buffer[65536];
+    std::size_t count;
+
+    contents.clear();
+
+    while ((count = std::fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        contents.append(buffer, count);
+
+    bool ok = !std::ferror(fp);
+    std::fclose(fp);
+    return ok;
+}
+
+// FNV-1a
+static std::uint64_t HashContents(const std::string& contents)
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+
+    for (unsigned char c : contents)
+        hash = (hash ^ c) * 1099511628211ULL;
+
+    return hash;
+}
+
+DependencyCache::DependencyCache(std::string path) : m_path(path), m_isDirty(false)
+{
+    if (!m_path.empty())
+        Load();
+}
+
+// Indexes the cache file by path. A missing or malformed cache is simply
+// ignored from the first bad entry on.
+void DependencyCache::Load()
+{
+    if (!ReadFile(m_path, m_text))
+        return;
+
+    const char *text = m_text.c_str();
+    const char *end = text + m_text.size();
+    std::size_t headerLength = std::strlen(kCacheHeader);
+
+    if (m_text.compare(0, headerLength, kCacheHeader) != 0 || text[headerLength] != '\n')
+        return;
+
+    const char *p = text + headerLength + 1;
+
+    while (p < end)
+    {
+        const char *tab = static_cast<const char *>(std::memchr(p, '\t', end - p));
+
+        if (tab == NULL)
+            return;
+
+        long lineCount = std::strtol(tab + 1, NULL, 10) + 1;
+        const char *entryEnd = p;
+
+        for (; lineCount > 0; lineCount--)
+        {
+            entryEnd = static_cast<const char *>(std::memchr(entryEnd, '\n', end - entryEnd));
+
+            if (entryEnd == NULL)
+                return;
+
+            entryEnd++;
+        }
+
+        Entry& entry = m_entries[std::string(p, tab - p)];
+        entry.isParsed = false;
+        entry.isChecked = false;
+        entry.textOffset = p - text;
+        entry.textLength = entryEnd - p;
+
+        p = entryEnd;
+    }
+}
+
+// Parses an entry that was loaded from the cache file.
+bool DependencyCache::Parse(Entry& entry)
+{
+    const char *p = m_text.c_str() + entry.textOffset;
+    const char *end = p + entry.textLength;
+    unsigned long long hash;
+    int dependencyCount;
+
+    p = static_cast<const char *>(std::memchr(p, '\t', end - p));
+
+    if (std::sscanf(p, "\t%d\t%lld\t%lld\t%lld\t%llx\n", &dependencyCount, &entry.size, &entry.mtime, &entry.scanTime, &hash) != 5)
+        return false;
+
+    entry.hash = hash;
+    p = static_cast<const char *>(std::memchr(p, '\n', end - p)) + 1;
+
+    for (int i = 0; i < dependencyCount; i++)
+    {
+        const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+
+        if (p[0] == 'I' && p[1] == '\t')
+            entry.dependencies.includes.insert(std::string(p + 2, lineEnd - p - 2));
+        else if (p[0] == 'B' && p[1] == '\t')
+            entry.dependencies.incbins.insert(std::string(p + 2, lineEnd - p - 2));
+        else
+            return false;
+
+        p = lineEnd + 1;
+    }
+
+    entry.isParsed = true;
+    return true;
+}
+
+const FileDependencies& DependencyCache::Get(const std::string& path)
+{
+    auto it = m_entries.find(path);
+
+    if (it != m_entries.end() && it->second.isChecked)
+        return it->second.dependencies;
+
+    // Without a cache file, entries only have to last for this run.
+    struct stat st;
+    bool isPersistent = !m_path.empty();
+    bool exists = isPersistent && stat(path.c_str(), &st) == 0;
+
+    if (exists && it != m_entries.end() && (it->second.isParsed || Parse(it->second)))
+    {
+        Entry& entry = it->second;
+
+        // A file modified in the same second as it was scanned could have
+        // changed without its mtime changing, so the hash has to decide.
+        if (entry.size == st.st_size && entry.mtime == st.st_mtime && entry.mtime < entry.scanTime)
+        {
+            entry.isChecked = true;
+            return entry.dependencies;
+        }
+
+        std::string contents;
+
+        if (entry.size == st.st_size && ReadFile(path, contents) && HashContents(contents) == entry.hash)
+        {
+            entry.mtime = st.st_mtime;
+            entry.scanTime = std::time(nullptr);
+            entry.isChecked = true;
+            m_isDirty = true;
+            return entry.dependencies;
+        }
+    }
+
+    Entry entry;
+    entry.isParsed = true;
+    entry.isChecked = true;
+
+    if (isPersistent)
+    {
+        std::string contents;
+
+        if (!exists || !ReadFile(path, contents))
+            FATAL_ERROR("Failed to open \"%s\" for reading.\n", path.c_str());
+
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtime;
+        entry.scanTime = std::time(nullptr);
+        entry.hash = HashContents(contents);
+        m_isDirty = true;
+    }
+
+    {
+        SourceFile file(path);
+        entry.dependencies.includes = file.GetIncludes();
+        entry.dependencies.incbins = file.GetIncbins();
+    }
+
+    Entry& stored = m_entries[path];
+    stored = std::move(entry);
+    return stored.dependencies;
+}
+
+// Writes the cache back out if anything changed. Concurrent runs each rename
+// their own complete copy into place, so the last one wins and whatever the
+// others added is just scanned again later.
+void DependencyCache::Save()
+{
+    if (m_path.empty() || !m_isDirty)
+        return;
+
+    std::string tempPath = m_path + ".tmp" + std::to_string(getpid());
+    FILE *fp = std::fopen(tempPath.c_str(), "wb");
+
+    if (fp == NULL)
+        return;
+
+    std::fprintf(fp, "%s\n", kCacheHeader);
+
+    for (const auto& it : m_entries)
+    {
+        const Entry& entry = it.second;
+
+        if (!entry.isParsed)
+        {
+            std::fwrite(m_text.data() + entry.textOffset, 1, entry.textLength, fp);
+            continue;
+        }
+
+        std::fprintf(fp, "%s\t%d\t%lld\t%lld\t%lld\t%llx\n", it.first.c_str(),
+            (int)(entry.dependencies.includes.size() + entry.dependencies.incbins.size()),
+            entry.size, entry.mtime, entry.scanTime, (unsigned long long)entry.hash);
+
+        for (const std::string& include : entry.dependencies.includes)
+            std::fprintf(fp, "I\t%s\n", include.c_str());
+
+        for (const std::string& incbin : entry.dependencies.incbins)
+            std::fprintf(fp, "B\t%s\n", incbin.c_str());
+    }
+
+    bool ok = !std::ferror(fp);
+
+    if (std::fclose(fp) != 0 || !ok)
+    {
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+#ifdef _WIN32
+    std::remove(m_path.c_str());
+#endif
+
+    if (std::rename(tempPath.c_str(), m_path.c_str()) != 0)
+        std::remove(tempPath.c_str());
+}
@@ -0,0 +1,54 @@
+#ifndef DEPENDENCY_CACHE_H
+#define DEPENDENCY_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+// The includes and incbins named directly in one file.
+struct FileDependencies
+{
+    std::set<std::string> includes;
+    std::set<std::string> incbins;
+};
+
+// Scan results for individual files, optionally kept on disk between runs so
+// that the headers shared by every source (global.h and friends) are only
+// tokenized again when they change. An entry is reused if the file's size
+// and mtime match, or failing that, if the hash of its contents does.
+class DependencyCache
+{
+public:
+    // An empty path keeps the cache in memory only.
+    DependencyCache(std::string path);
+    const FileDependencies& Get(const std::string& path);
+    void Save();
+
+private:
+    // Entries loaded from the cache file are only parsed when they're looked
+    // up; the rest are written back out as they were.
+    struct Entry
+    {
+        bool isParsed;
+        bool isChecked;
+        std::size_t textOffset;
+        std::size_t textLength;
+        long long size;
+        long long mtime;
+        long long scanTime;
+        std::uint64_t hash;
+        FileDependencies dependencies;
+    };
+
+    std::string m_path;
+    std::string m_text;
+    std::unordered_map<std::string, Entry> m_entries;
+    bool m_isDirty;
+
+    void Load();
+    bool Parse(Entry& entry);
+};
+
+#endif // DEPENDENCY_CACHE_H
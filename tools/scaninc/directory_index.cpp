@@ -0,0 +1,62 @@
+#include <sys/stat.h>
+#include "directory_index.h"
+
+#ifndef _MSC_VER
+#include <dirent.h>
+#endif
+
+bool DirectoryIndex::Probe(const std::string& path)
+{
+    auto it = m_probes.find(path);
+
+    if (it != m_probes.end())
+        return it->second;
+
+    struct stat st;
+    bool exists = stat(path.c_str(), &st) == 0;
+
+    m_probes.emplace(path, exists);
+    return exists;
+}
+
+void DirectoryIndex::List(const std::string& dir, Directory& directory)
+{
+    directory.isListed = true;
+
+#ifndef _MSC_VER
+    // A directory that can't be read is indexed as empty, so nothing in it
+    // resolves, same as when opening the file fails.
+    DIR *dp = opendir(dir.empty() ? "." : dir.c_str());
+
+    if (dp != NULL)
+    {
+        struct dirent *entry;
+
+        while ((entry = readdir(dp)) != NULL)
+            directory.names.insert(entry->d_name);
+
+        closedir(dp);
+    }
+#endif
+}
+
+bool DirectoryIndex::Contains(const std::string& path)
+{
+    std::size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    Directory& directory = m_directories[dir];
+
+    if (!directory.isListed)
+    {
+#ifndef _MSC_VER
+        if (directory.probeCount++ < kProbesBeforeListing)
+            return Probe(path);
+
+        List(dir, directory);
+#else
+        return Probe(path);
+#endif
+    }
+
+    return directory.names.count(path.substr(dir.size())) != 0;
+}
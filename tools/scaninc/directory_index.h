@@ -0,0 +1,36 @@
+#ifndef DIRECTORY_INDEX_H
+#define DIRECTORY_INDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Answers "does this file exist" from directory listings instead of opening
+// the file. Include paths are searched in order, so the common headers are
+// looked up in the same few directories over and over; each of those is read
+// once and the rest of the lookups are hash lookups. Directories that are
+// only looked in once or twice, like each map's folder, are probed with stat
+// instead, since listing them would cost more than it saves.
+class DirectoryIndex
+{
+public:
+    bool Contains(const std::string& path);
+
+private:
+    static const int kProbesBeforeListing = 2;
+
+    struct Directory
+    {
+        int probeCount;
+        bool isListed;
+        std::unordered_set<std::string> names;
+    };
+
+    std::unordered_map<std::string, Directory> m_directories;
+    std::unordered_map<std::string, bool> m_probes;
+
+    bool Probe(const std::string& path);
+    void List(const std::string& dir, Directory& directory);
+};
+
+#endif // DIRECTORY_INDEX_H
@@ -0,0 +1,74 @@
+#include <queue>
+#include "include_graph.h"
+#include "source_file.h"
+
+IncludeGraph::IncludeGraph(const std::vector<std::string>& includeDirs, DependencyCache& cache)
+    : m_includeDirs(includeDirs), m_cache(cache)
+{
+}
+
+const IncludeGraph::Node& IncludeGraph::GetNode(const std::string& path)
+{
+    auto it = m_nodes.find(path);
+
+    if (it != m_nodes.end())
+        return it->second;
+
+    std::string filePath(path);
+    const FileDependencies& file = m_cache.Get(filePath);
+    SourceFileType fileType = GetFileType(filePath);
+    Node& node = m_nodes[path];
+
+    node.incbins = &file.incbins;
+    m_includeDirs.push_back(GetDir(filePath));
+
+    for (const std::string& include : file.includes)
+    {
+        bool exists = false;
+        std::string includePath;
+
+        for (const std::string& includeDir : m_includeDirs)
+        {
+            includePath = includeDir + include;
+            if (m_index.Contains(includePath))
+            {
+                exists = true;
+                break;
+            }
+        }
+        if (!exists && (fileType == SourceFileType::Asm || fileType == SourceFileType::Inc))
+        {
+            includePath = include;
+            if (m_index.Contains(includePath))
+                exists = true;
+        }
+        if (exists)
+            node.includes.push_back(includePath);
+    }
+
+    m_includeDirs.pop_back();
+    return node;
+}
+
+void IncludeGraph::CollectDependencies(const std::string& initialPath, std::set<std::string>& dependencies, std::set<std::string>& includes)
+{
+    std::queue<std::string> filesToProcess;
+
+    filesToProcess.push(initialPath);
+
+    while (!filesToProcess.empty())
+    {
+        const Node& node = GetNode(filesToProcess.front());
+        filesToProcess.pop();
+
+        for (const std::string& incbin : *node.incbins)
+            dependencies.insert(incbin);
+
+        for (const std::string& path : node.includes)
+        {
+            includes.insert(path);
+            if (dependencies.insert(path).second)
+                filesToProcess.push(path);
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef INCLUDE_GRAPH_H
+#define INCLUDE_GRAPH_H
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "dependency_cache.h"
+#include "directory_index.h"
+
+// The include graph of a set of sources. Each file's includes are resolved
+// against the include paths once, the first time it's reached, so headers
+// shared between sources are only looked up again for the first of them.
+class IncludeGraph
+{
+public:
+    IncludeGraph(const std::vector<std::string>& includeDirs, DependencyCache& cache);
+    void CollectDependencies(const std::string& initialPath, std::set<std::string>& dependencies, std::set<std::string>& includes);
+
+private:
+    struct Node
+    {
+        const std::set<std::string> *incbins;
+        std::vector<std::string> includes;
+    };
+
+    std::vector<std::string> m_includeDirs;
+    DependencyCache& m_cache;
+    DirectoryIndex m_index;
+    std::unordered_map<std::string, Node> m_nodes;
+
+    const Node& GetNode(const std::string& path);
+};
+
+#endif // INCLUDE_GRAPH_H
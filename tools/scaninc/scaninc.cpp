@@ -20,50 +20,147 @@
 
 #include <cstdio>
 #include <cstdlib>
-#include <list>
-#include <queue>
+#include <algorithm>
+#include <atomic>
 #include <set>
 #include <string>
 #include <iostream>
-#include <tuple>
+#include <thread>
 #include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
 #include "scaninc.h"
 #include "source_file.h"
+#include "dependency_cache.h"
+#include "include_graph.h"
 
-bool CanOpenFile(std::string path)
+const char *const USAGE =
+    "Usage: scaninc [-I INCLUDE_PATH] [-M DEPENDENCY_OUT_PATH] [-C CACHE_PATH] FILE_PATH\n"
+    "       scaninc [-I INCLUDE_PATH] [-C CACHE_PATH] [-S STAMP_PATH] -B BUILD_DIR FILE_PATH...\n";
+
+// The dependencies of one source, and where to write them out.
+struct ScanResult
+{
+    std::string source;
+    std::string make_outfile;
+    std::set<std::string> dependencies;
+    std::set<std::string> dependencies_includes;
+};
+
+// With a stamp path, the dependency list rule is written for the stamp instead
+// of the dependency file, so that one rule remakes every dependency file at once.
+static std::string FormatMakeRules(const ScanResult& result, const std::string& stamp)
 {
-    FILE *fp = std::fopen(path.c_str(), "rb");
+    std::ostringstream output;
+
+    // Print a make rule for the object file
+    size_t ext_pos = result.make_outfile.find_last_of(".");
+    auto object_file = result.make_outfile.substr(0, ext_pos + 1) + "o";
+    output << object_file.c_str() << ":";
+    for (const std::string &path : result.dependencies)
+    {
+        output << " " << path;
+    }
+    output << '\n';
+
+    // Dependency list rule.
+    // Although these rules are identical, they need to be separate, else make will trigger the rule again after the file is created for the first time.
+    if (stamp.empty())
+        output << result.make_outfile.c_str() << ":";
+    else
+        output << stamp.c_str() << ": " << result.source.c_str();
+    for (const std::string &path : result.dependencies_includes)
+    {
+        output << " " << path;
+    }
+    output << '\n';
 
-    if (fp == NULL)
-        return false;
+    // Dummy rules
+    // If a dependency is deleted, make will try to make it, instead of rescanning the dependencies before trying to do that.
+    for (const std::string &path : result.dependencies)
+    {
+        output << path << ":\n";
+    }
 
-    std::fclose(fp);
-    return true;
+    return output.str();
 }
 
-const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] [-M DEPENDENCY_OUT_PATH] FILE_PATH\n";
+static void WriteMakeRules(const ScanResult& result, const std::string& stamp = "")
+{
+    std::ofstream output(result.make_outfile);
 
-int main(int argc, char **argv)
+    if (!output.is_open())
+        FATAL_ERROR("Couldn't open \"%s\" for writing.\n", result.make_outfile.c_str());
+
+    output << FormatMakeRules(result, stamp);
+    output.flush();
+    output.close();
+}
+
+static long long GetModificationTime(const std::string& path)
 {
-    std::queue<std::string> filesToProcess;
-    std::set<std::string> dependencies;
-    std::set<std::string> dependencies_includes;
+    struct stat st;
+
+    return stat(path.c_str(), &st) == 0 ? (long long)st.st_mtime : -1;
+}
+
+// A dependency file is left alone if it already has the right contents and is
+// newer than everything its rule depends on, so make doesn't remake it and
+// restart, and the common case is a read instead of a write.
+static void UpdateMakeRules(const ScanResult& result, const std::unordered_map<std::string, long long>& mtimes, const std::string& stamp)
+{
+    long long newest = mtimes.at(result.source);
+
+    for (const std::string &path : result.dependencies_includes)
+        newest = std::max(newest, mtimes.at(path));
+
+    if (GetModificationTime(result.make_outfile) > newest)
+    {
+        std::ifstream input(result.make_outfile, std::ios::binary);
+        std::ostringstream contents;
+
+        contents << input.rdbuf();
+        if (contents.str() == FormatMakeRules(result, stamp))
+            return;
+    }
+
+    WriteMakeRules(result, stamp);
+}
+
+// Maps "src/foo.c" to "BUILD_DIR/src/foo.d".
+static std::string GetDependencyFilePath(const std::string& buildDir, const std::string& path)
+{
+    std::size_t slash = path.rfind('/');
+    std::size_t dot = path.rfind('.');
 
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = path.size();
+
+    return buildDir + "/" + path.substr(0, dot) + ".d";
+}
+
+int main(int argc, char **argv)
+{
     std::vector<std::string> includeDirs;
 
     bool makeformat = false;
     std::string make_outfile;
+    std::string cache_path;
+    std::string build_dir;
+    std::string stamp_path;
 
     argc--;
     argv++;
 
-    while (argc > 1)
+    while (argc > 0 && argv[0][0] == '-')
     {
         std::string arg(argv[0]);
         if (arg.substr(0, 2) == "-I")
         {
             std::string includeDir = arg.substr(2);
-            if (includeDir.empty())
+            if (includeDir.empty() && argc > 1)
             {
                 argc--;
                 argv++;
@@ -75,13 +172,31 @@ int main(int argc, char **argv)
             }
             includeDirs.push_back(includeDir);
         }
-        else if(arg.substr(0, 2) == "-M")
+        else if(arg.substr(0, 2) == "-M" && argc > 1)
         {
             makeformat = true;
             argc--;
             argv++;
             make_outfile = std::string(argv[0]);
         }
+        else if(arg.substr(0, 2) == "-C" && argc > 1)
+        {
+            argc--;
+            argv++;
+            cache_path = std::string(argv[0]);
+        }
+        else if(arg.substr(0, 2) == "-B" && argc > 1)
+        {
+            argc--;
+            argv++;
+            build_dir = std::string(argv[0]);
+        }
+        else if(arg.substr(0, 2) == "-S" && argc > 1)
+        {
+            argc--;
+            argv++;
+            stamp_path = std::string(argv[0]);
+        }
         else
         {
             FATAL_ERROR(USAGE);
@@ -90,60 +205,67 @@ int main(int argc, char **argv)
         argv++;
     }
 
-    if (argc != 1) {
+    if (build_dir.empty() ? (argc != 1 || !stamp_path.empty()) : (argc < 1 || makeformat)) {
         FATAL_ERROR(USAGE);
     }
 
-    std::string initialPath(argv[0]);
-
-    filesToProcess.push(initialPath);
+    DependencyCache cache(cache_path);
+    IncludeGraph graph(includeDirs, cache);
 
-    while (!filesToProcess.empty())
+    if (!build_dir.empty())
     {
-        std::string filePath = filesToProcess.front();
-        SourceFile file(filePath);
-        filesToProcess.pop();
+        // Scan every source against the one graph, then bring the dependency
+        // files up to date from a pool of threads.
+        std::vector<ScanResult> results(argc);
 
-        includeDirs.push_back(file.GetSrcDir());
-        for (auto incbin : file.GetIncbins())
+        std::unordered_map<std::string, long long> mtimes;
+
+        for (int i = 0; i < argc; i++)
         {
-            dependencies.insert(incbin);
+            results[i].source = argv[i];
+            results[i].make_outfile = GetDependencyFilePath(build_dir, argv[i]);
+            graph.CollectDependencies(argv[i], results[i].dependencies, results[i].dependencies_includes);
         }
-        for (auto include : file.GetIncludes())
-        {
-            bool exists = false;
-            std::string path("");
-            for (auto includeDir : includeDirs)
-            {
-                path = includeDir + include;
-                if (CanOpenFile(path))
-                {
-                    exists = true;
-                    break;
-                }
-            }
-            if (!exists && (file.FileType() == SourceFileType::Asm || file.FileType() == SourceFileType::Inc))
-            {
-                path = include;
-                if (CanOpenFile(path))
-                    exists = true;
-            }
-            if (!exists)
-                continue;
 
-            dependencies_includes.insert(path);
-            bool inserted = dependencies.insert(path).second;
-            if (inserted && exists)
-            {
-                filesToProcess.push(path);
-            }
+        cache.Save();
+
+        // Timestamps are collected up front, so the workers only read the map.
+        for (const ScanResult& result : results)
+        {
+            mtimes.emplace(result.source, GetModificationTime(result.source));
+            for (const std::string &path : result.dependencies_includes)
+                if (mtimes.find(path) == mtimes.end())
+                    mtimes.emplace(path, GetModificationTime(path));
         }
-        includeDirs.pop_back();
+
+        std::atomic<int> nextResult(0);
+        auto worker = [&]() {
+            int i;
+            while ((i = nextResult++) < argc)
+                UpdateMakeRules(results[i], mtimes, stamp_path);
+        };
+
+        int threadCount = std::min<int>(std::max(1u, std::thread::hardware_concurrency()), argc);
+        std::vector<std::thread> threads;
+
+        for (int i = 1; i < threadCount; i++)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread& thread : threads)
+            thread.join();
+
+        return 0;
     }
 
+    ScanResult result;
+    result.make_outfile = make_outfile;
+    graph.CollectDependencies(argv[0], result.dependencies, result.dependencies_includes);
+
+    cache.Save();
+
     if(!makeformat)
     {
-        for (const std::string &path : dependencies)
+        for (const std::string &path : result.dependencies)
         {
             std::printf("%s\n", path.c_str());
         }
@@ -152,35 +274,6 @@ int main(int argc, char **argv)
     else
     {
         // Write out make rules to a file
-        std::ofstream output(make_outfile);
-
-        // Print a make rule for the object file
-        size_t ext_pos = make_outfile.find_last_of(".");
-        auto object_file = make_outfile.substr(0, ext_pos + 1) + "o";
-        output << object_file.c_str() << ":";
-        for (const std::string &path : dependencies)
-        {
-            output << " " << path;
-        }
-        output << '\n';
-
-        // Dependency list rule.
-        // Although these rules are identical, they need to be separate, else make will trigger the rule again after the file is created for the first time.
-        output << make_outfile.c_str() << ":";
-        for (const std::string &path : dependencies_includes)
-        {
-            output << " " << path;
-        }
-        output << '\n';
-
-        // Dummy rules
-        // If a dependency is deleted, make will try to make it, instead of rescanning the dependencies before trying to do that.
-        for (const std::string &path : dependencies)
-        {
-            output << path << ":\n";
-        }
-
-        output.flush();
-        output.close();
+        WriteMakeRules(result);
     }
 }